@@ -3,20 +3,24 @@
 //
 
 #include <cassert>
+#include <algorithm>
+#include <thread>
 #include "blocking_buffer.hpp"
+#include "log.hpp"
 
 
 BlockingBuffer::BlockingBuffer(size_t chunk_size)
     : chunk_size_(chunk_size), has_chunk_count_limit_(false),
-    max_chunk_count_(SIZE_MAX), min_chunk_count_(0), is_exit_(false) {}
+    max_chunk_count_(SIZE_MAX), min_chunk_count_(0), is_exit_(false), max_pooled_chunks_(kDefaultPoolSize) {}
 
 BlockingBuffer::BlockingBuffer(size_t chunk_size, size_t max_chunk_count)
     : chunk_size_(chunk_size), has_chunk_count_limit_(true),
-    max_chunk_count_(max_chunk_count), min_chunk_count_(0), is_exit_(false) {}
+    max_chunk_count_(max_chunk_count), min_chunk_count_(0), is_exit_(false), max_pooled_chunks_(max_chunk_count + 1) {}
 
 BlockingBuffer::BlockingBuffer(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count)
     : chunk_size_(chunk_size), has_chunk_count_limit_(true),
-    max_chunk_count_(max_chunk_count), min_chunk_count_(min_chunk_count), is_exit_(false) {}
+    max_chunk_count_(max_chunk_count), min_chunk_count_(min_chunk_count), is_exit_(false),
+    max_pooled_chunks_(max_chunk_count + 1) {}
 
 BlockingBuffer::~BlockingBuffer() {
     if (!is_exit_) {
@@ -24,6 +28,66 @@ BlockingBuffer::~BlockingBuffer() {
     }
 }
 
+template <typename Predicate>
+void BlockingBuffer::ConsumerWait(std::unique_lock<std::mutex>& locker, Predicate pred) {
+    // mutex_ should be held by locker
+    if (pred()) {
+        return;
+    }
+
+    if (wakeup_policy_.spin_count > 0) {
+        // Spin shortly before parking, the producer is likely to publish within microseconds
+        size_t readable = readable_bytes_;
+        locker.unlock();
+        for (int i = 0; i < wakeup_policy_.spin_count; i++) {
+            if (readable_bytes_ != readable || is_exit_) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+        locker.lock();
+
+        if (pred()) {
+            spin_hits_++;
+            return;
+        }
+    }
+
+    // Coalesce from here on: bytes written while nobody was parked were never withheld
+    consumer_waiting_ = true;
+    pending_wakeup_bytes_ = 0;
+    last_wakeup_ = std::chrono::steady_clock::now();
+
+    if (wakeup_policy_.max_delay_ms > 0) {
+        // Bound the latency added by withheld notifications
+        auto max_delay = std::chrono::milliseconds(wakeup_policy_.max_delay_ms);
+        while (!consume_cv_.wait_for(locker, max_delay, pred)) {}
+    } else {
+        consume_cv_.wait(locker, pred);
+    }
+
+    consumer_waiting_ = false;
+}
+
+template <typename Predicate>
+void BlockingBuffer::ProducerWait(std::unique_lock<std::mutex>& locker, Predicate pred) {
+    // mutex_ should be held by locker
+    if (pred()) {
+        return;
+    }
+
+    // The consumer must drain before we can go on, wake it regardless of the policy
+    if (consumer_waiting_) {
+        consume_cv_.notify_one();
+        wakeups_sent_++;
+        pending_wakeup_bytes_ = 0;
+    }
+
+    producer_waiting_ = true;
+    produce_cv_.wait(locker, pred);
+    producer_waiting_ = false;
+}
+
 size_t BlockingBuffer::Read(uint8_t* buffer, size_t expected_bytes) {
     // I am the data consumer
     assert(buffer != nullptr);
@@ -32,10 +96,13 @@ size_t BlockingBuffer::Read(uint8_t* buffer, size_t expected_bytes) {
 
     std::unique_lock locker(mutex_);
 
+    ReleaseLeasedChunk();
+    RefillFromSpill();
+
     if (has_chunk_count_limit_ && deque_.size() < min_chunk_count_) {
-        produce_cv_.notify_one();
+        NotifyProducer();
         // consumer standby, waiting notify message from the producer
-        consume_cv_.wait(locker, [this] {
+        ConsumerWait(locker, [this] {
             return deque_.size() >= min_chunk_count_ || is_exit_;
         });
     }
@@ -46,9 +113,9 @@ size_t BlockingBuffer::Read(uint8_t* buffer, size_t expected_bytes) {
 
     while (remain_unread > 0) {
         if (deque_.empty() && !is_exit_) {
-            produce_cv_.notify_one();
+            NotifyProducer();
             // Wait for producing
-            consume_cv_.wait(locker, [this] {
+            ConsumerWait(locker, [this] {
                 return !deque_.empty() || is_exit_;
             });
 
@@ -57,27 +124,32 @@ size_t BlockingBuffer::Read(uint8_t* buffer, size_t expected_bytes) {
             }
         }
 
+        if (resync_pending_ && !deque_.empty()) {
+            SkipToSync();
+        }
+
         auto& front_chunk = deque_.front();
 
         if (front_chunk.RemainReadable() == 0) {
-            deque_.pop_front();
+            RecycleFrontChunk();
             continue;
         }
 
         size_t request_bytes = std::min(static_cast<size_t>(remain_unread), front_chunk.RemainReadable());
         size_t chunk_read = front_chunk.Read(out, request_bytes);
+        readable_bytes_ -= chunk_read;
 
         bytes_read += chunk_read;
         remain_unread -= chunk_read;
         out += chunk_read;
 
         if (front_chunk.RemainReadable() == 0) {
-            deque_.pop_front();
+            RecycleFrontChunk();
         }
     }
 
     // Notify the data producer to produce data
-    produce_cv_.notify_one();
+    NotifyProducer();
     return bytes_read;
 }
 
@@ -85,10 +157,14 @@ std::pair<uint8_t*, size_t> BlockingBuffer::ReadChunkAndRetain() {
     // I am the data consumer
     std::unique_lock locker(mutex_);
 
+    // The caller is done with the previous lease
+    ReleaseLeasedChunk();
+    RefillFromSpill();
+
     if (has_chunk_count_limit_ && deque_.size() < min_chunk_count_) {
-        produce_cv_.notify_one();
+        NotifyProducer();
         // consumer standby, waiting notify message from the producer
-        consume_cv_.wait(locker, [this] {
+        ConsumerWait(locker, [this] {
             return deque_.size() >= min_chunk_count_ || is_exit_;
         });
     }
@@ -98,9 +174,9 @@ std::pair<uint8_t*, size_t> BlockingBuffer::ReadChunkAndRetain() {
 
     while (!buffer_ptr) {
         if (deque_.empty() && !is_exit_) {
-            produce_cv_.notify_one();
+            NotifyProducer();
             // Wait for producing
-            consume_cv_.wait(locker, [this] {
+            ConsumerWait(locker, [this] {
                 return !deque_.empty() || is_exit_;
             });
         }
@@ -109,21 +185,31 @@ std::pair<uint8_t*, size_t> BlockingBuffer::ReadChunkAndRetain() {
             break;
         }
 
+        if (resync_pending_) {
+            SkipToSync();
+        }
+
         Chunk& front_chunk = deque_.front();
 
         if (front_chunk.RemainReadable() == 0) {
-            deque_.pop_front();
+            RecycleFrontChunk();
             continue;
         }
 
-        buffer_ptr = front_chunk.vec_.data() + front_chunk.read_pos_;
+        buffer_ptr = front_chunk.data_.get() + front_chunk.read_pos_;
         bytes = front_chunk.RemainReadable();
+        readable_bytes_ -= bytes;
         // fast-forward read_pos_ to write_pos_ (mark as consumed)
         front_chunk.read_pos_ = front_chunk.write_pos_;
+
+        // Detach the chunk even if it is the back one, the producer will start a new chunk
+        // instead of appending to the memory we've just handed out
+        leased_chunk_.emplace(std::move(front_chunk));
+        deque_.pop_front();
     }
 
     // Notify the data producer to produce data
-    produce_cv_.notify_one();
+    NotifyProducer();
 
     return {buffer_ptr, bytes};
 }
@@ -136,44 +222,89 @@ size_t BlockingBuffer::Write(const uint8_t *buffer, size_t bytes) {
 
     std::unique_lock locker(mutex_);
 
-    if (has_chunk_count_limit_ && deque_.size() >= max_chunk_count_) {
-        consume_cv_.notify_one();
-        // producer standby, waiting notify message from the consumer
-        produce_cv_.wait(locker, [this] {
-            return deque_.size() < max_chunk_count_ || is_exit_;
+    if (overflow_policy_ == kOverflowPolicyBlock && has_chunk_count_limit_ && deque_.size() >= max_chunk_count_) {
+        // producer standby, waiting notify message from the consumer, or for a policy which doesn't block
+        ProducerWait(locker, [this] {
+            return deque_.size() < max_chunk_count_ || overflow_policy_ != kOverflowPolicyBlock || is_exit_;
         });
     }
 
     const uint8_t* in = buffer;
     size_t bytes_written = 0;
     ptrdiff_t remain_unwrite = static_cast<ptrdiff_t>(bytes);
+    bool chunk_completed = false;
 
     while (remain_unwrite > 0) {
-        if (deque_.size() >= max_chunk_count_) {
-            consume_cv_.notify_one();
-            // Wait for consuming
-            produce_cv_.wait(locker, [this] {
-                return deque_.size() < max_chunk_count_ || is_exit_;
+        bool is_full = deque_.size() >= max_chunk_count_;
+        bool needs_new_chunk = deque_.empty() || deque_.back().RemainWritable() == 0;
+
+        if (overflow_policy_ == kOverflowPolicySpillToDisk && (spill_.Size() > 0 || (is_full && needs_new_chunk))) {
+            // Once spilling has started everything goes to the spill file until the consumer
+            // has drained it, otherwise the data would be delivered out of order
+            if (spill_.Size() + remain_unwrite <= spill_.Capacity()) {
+                if (spill_.Write(in, remain_unwrite)) {
+                    spilled_bytes_ += remain_unwrite;
+                    bytes_written += remain_unwrite;
+                    remain_unwrite = 0;
+                    break;
+                }
+                Log::ErrorF("BlockingBuffer::Write(): Spilling to disk failed, fall back to blocking");
+                overflow_policy_ = kOverflowPolicyBlock;
+            }
+
+            // Spill file is full, wait for the consumer to make room. If it is broken,
+            // wait until it is drained so that the rest is still delivered in order.
+            ProducerWait(locker, [this, remain_unwrite] {
+                bool has_room = overflow_policy_ == kOverflowPolicySpillToDisk &&
+                                spill_.Size() + static_cast<uint64_t>(remain_unwrite) <= spill_.Capacity();
+                return spill_.Size() == 0 || has_room || is_exit_;
+            });
+
+            if (is_exit_) {
+                break;
+            }
+            continue;
+        }
+
+        if (overflow_policy_ == kOverflowPolicyDropOldest) {
+            if (is_full && needs_new_chunk) {
+                DropFrontChunk();
+            }
+        } else if (is_full && needs_new_chunk) {
+            // Wait for consuming. SetOverflowPolicy() may switch to a policy which makes room
+            // by itself meanwhile, so start over with whatever is in effect then.
+            ProducerWait(locker, [this] {
+                return deque_.size() < max_chunk_count_ || overflow_policy_ != kOverflowPolicyBlock || is_exit_;
             });
+
+            if (is_exit_) {
+                break;
+            }
+            continue;
         }
 
         if (deque_.empty() || deque_.back().RemainWritable() == 0) {
             // No existing chunk, or back chunk is full
-            deque_.emplace_back(chunk_size_);
+            deque_.push_back(AcquireChunk());
         }
 
         auto& back_chunk = deque_.back();
 
         size_t attempt_bytes = std::min(static_cast<size_t>(remain_unwrite), back_chunk.RemainWritable());
         size_t chunk_written = back_chunk.Write(in, attempt_bytes);
+        readable_bytes_ += chunk_written;
 
         bytes_written += chunk_written;
         remain_unwrite -= chunk_written;
         in += chunk_written;
+
+        if (back_chunk.RemainWritable() == 0) {
+            chunk_completed = true;
+        }
     }
 
     // Notify the consumer to consume data
-    consume_cv_.notify_one();
+    NotifyConsumer(bytes_written, chunk_completed);
     return bytes_written;
 }
 
@@ -184,19 +315,20 @@ size_t BlockingBuffer::WriteChunk(const std::vector<uint8_t>& vec) {
     std::unique_lock locker(mutex_);
 
     if (has_chunk_count_limit_ && deque_.size() >= max_chunk_count_) {
-        consume_cv_.notify_one();
         // producer standby, waiting notify message from the consumer
-        produce_cv_.wait(locker, [this] {
+        ProducerWait(locker, [this] {
             return deque_.size() < max_chunk_count_ || is_exit_;
         });
     }
 
     size_t bytes = vec.size();
-    std::vector<uint8_t> vec_clone = vec;
-    deque_.emplace_back(std::move(vec_clone));
+    Chunk chunk = AcquireChunk();
+    chunk.Write(vec.data(), bytes);
+    deque_.push_back(std::move(chunk));
+    readable_bytes_ += bytes;
 
     // Notify the consumer to consume data
-    consume_cv_.notify_one();
+    NotifyConsumer(bytes, true);
     return bytes;
 }
 
@@ -207,30 +339,45 @@ size_t BlockingBuffer::WriteChunk(std::vector<uint8_t>&& vec) {
     std::unique_lock locker(mutex_);
 
     if (has_chunk_count_limit_ && deque_.size() >= max_chunk_count_) {
-        consume_cv_.notify_one();
         // producer standby, waiting notify message from the consumer
-        produce_cv_.wait(locker, [this] {
+        ProducerWait(locker, [this] {
             return deque_.size() < max_chunk_count_ || is_exit_;
         });
     }
 
     size_t bytes = vec.size();
-    deque_.emplace_back(std::move(vec));
+    Chunk chunk = AcquireChunk();
+    chunk.Write(vec.data(), bytes);
+    deque_.push_back(std::move(chunk));
+    readable_bytes_ += bytes;
 
     // Notify the consumer to consume data
-    consume_cv_.notify_one();
+    NotifyConsumer(bytes, true);
     return bytes;
 }
 
+std::pair<uint8_t*, size_t> BlockingBuffer::GetWriteRegion() {
+    return {nullptr, 0};
+}
+
+void BlockingBuffer::CommitWrite(size_t bytes) {
+    assert(bytes == 0);
+}
+
 void BlockingBuffer::WaitUntilData() {
+    // Lock-free fast path: that many bytes imply at least min_chunk_count_ chunks
+    if (readable_bytes_ >= std::max<size_t>(min_chunk_count_ * chunk_size_, 1)) {
+        return;
+    }
+
     std::unique_lock locker(mutex_);
 
     if (has_chunk_count_limit_) {
-        consume_cv_.wait(locker, [this] {
+        ConsumerWait(locker, [this] {
             return deque_.size() >= min_chunk_count_ || is_exit_;
         });
     } else {
-        consume_cv_.wait(locker, [this] {
+        ConsumerWait(locker, [this] {
             return !deque_.empty() || is_exit_;
         });
     }
@@ -239,7 +386,7 @@ void BlockingBuffer::WaitUntilData() {
 void BlockingBuffer::WaitUntilEmpty() {
     std::unique_lock locker(mutex_);
 
-    produce_cv_.wait(locker, [this] {
+    ProducerWait(locker, [this] {
         return deque_.empty() || is_exit_;
     });
 }
@@ -253,34 +400,272 @@ void BlockingBuffer::NotifyExit() {
 }
 
 bool BlockingBuffer::IsExit() {
-    std::lock_guard guard(mutex_);
     return is_exit_;
 }
 
 size_t BlockingBuffer::ReadableBytes() {
+    return readable_bytes_;
+}
+
+size_t BlockingBuffer::WritableBytes() {
     std::lock_guard guard(mutex_);
 
-    size_t readable = 0;
+    if (!has_chunk_count_limit_ || overflow_policy_ != kOverflowPolicyBlock) {
+        return SIZE_MAX;
+    }
 
-    for (const Chunk& chunk : deque_) {
-        readable += chunk.RemainReadable();
+    // Write() waits up front as soon as the chunk count limit has been reached
+    if (deque_.size() >= max_chunk_count_) {
+        return 0;
     }
 
-    return readable;
+    size_t back_writable = deque_.empty() ? 0 : deque_.back().RemainWritable();
+    return (max_chunk_count_ - deque_.size()) * chunk_size_ + back_writable;
 }
 
 void BlockingBuffer::Clear() {
     std::lock_guard guard(mutex_);
 
-    deque_.clear();
+    spill_.Clear();
+
+    while (!deque_.empty()) {
+        RecycleFrontChunk();
+    }
+    readable_bytes_ = 0;
 }
 
+size_t BlockingBuffer::Purge() {
+    std::deque<Chunk> purged;
+    size_t purged_bytes = 0;
+
+    {
+        std::lock_guard guard(mutex_);
+
+        // Swapping the deque out is constant time, whatever the producer does next lands in a fresh chunk
+        purged_bytes = readable_bytes_ + static_cast<size_t>(spill_.Size());
+        purged.swap(deque_);
+        spill_.Clear();
+        readable_bytes_ = 0;
+        purged_bytes_ += purged_bytes;
+
+        // The producer may have been stopped in the middle of a packet
+        resync_pending_ = true;
+        NotifyProducer();
+    }
+
+    // Hand the buffers back to the pool in a second short critical section
+    std::lock_guard guard(mutex_);
+    for (Chunk& chunk : purged) {
+        RecycleChunk(std::move(chunk));
+    }
+
+    return purged_bytes;
+}
+
+void BlockingBuffer::SetWakeupPolicy(const WakeupPolicy& policy) {
+    std::lock_guard guard(mutex_);
+    wakeup_policy_ = policy;
+}
+
+void BlockingBuffer::SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes) {
+    std::lock_guard guard(mutex_);
+    overflow_policy_ = policy;
+    spill_.SetCapacity(spill_max_bytes);
+
+    // A producer parked under the old policy may not have to wait any more
+    produce_cv_.notify_all();
+}
+
+void BlockingBuffer::SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) {
+    std::lock_guard guard(mutex_);
+
+    has_chunk_count_limit_ = true;
+    max_chunk_count_ = std::max<size_t>((capacity_bytes + chunk_size_ - 1) / chunk_size_, 1);
+    min_chunk_count_ = std::min<size_t>((prebuffer_bytes + chunk_size_ - 1) / chunk_size_, max_chunk_count_);
+    max_pooled_chunks_ = max_chunk_count_ + 1;
+    if (free_chunks_.size() > max_pooled_chunks_) {
+        free_chunks_.resize(max_pooled_chunks_);
+    }
+
+    // Room may have been made for spilled data
+    RefillFromSpill();
+
+    // Either side may be parked on the old limits
+    consume_cv_.notify_all();
+    produce_cv_.notify_all();
+}
+
+size_t BlockingBuffer::PrebufferBytes() {
+    std::lock_guard guard(mutex_);
+    return has_chunk_count_limit_ ? min_chunk_count_ * chunk_size_ : 0;
+}
+
+StreamBufferStats BlockingBuffer::GetStats() {
+    std::lock_guard guard(mutex_);
+
+    StreamBufferStats stats;
+    stats.wakeups_sent = wakeups_sent_;
+    stats.wakeups_avoided = wakeups_avoided_;
+    stats.spin_hits = spin_hits_;
+    stats.discontinuities = discontinuities_;
+    stats.dropped_bytes = dropped_bytes_;
+    stats.spilled_bytes = spilled_bytes_;
+    stats.purged_bytes = purged_bytes_;
+    return stats;
+}
+
+size_t BlockingBuffer::ChunkAllocationCount() {
+    std::lock_guard guard(mutex_);
+    return chunk_allocations_;
+}
+
+BlockingBuffer::Chunk BlockingBuffer::AcquireChunk() {
+    // mutex_ should be held by caller
+    if (!free_chunks_.empty()) {
+        BufferArena::Ptr data = std::move(free_chunks_.back());
+        free_chunks_.pop_back();
+        return Chunk(std::move(data), chunk_size_);
+    }
+
+    chunk_allocations_++;
+    return Chunk(BufferArena::Instance().Allocate(chunk_size_), chunk_size_);
+}
+
+void BlockingBuffer::RecycleChunk(Chunk&& chunk) {
+    // mutex_ should be held by caller
+    if (free_chunks_.size() < max_pooled_chunks_) {
+        free_chunks_.push_back(std::move(chunk.data_));
+    }
+}
+
+void BlockingBuffer::RecycleFrontChunk() {
+    // mutex_ should be held by caller
+    RecycleChunk(std::move(deque_.front()));
+    deque_.pop_front();
+    RefillFromSpill();
+}
+
+void BlockingBuffer::DropFrontChunk() {
+    // mutex_ should be held by caller
+    size_t dropped = deque_.front().RemainReadable();
+    readable_bytes_ -= dropped;
+    dropped_bytes_ += dropped;
+    discontinuities_++;
+    RecycleFrontChunk();
+
+    // Only drop whole packets: let the new front start on a sync byte.
+    // Nothing is skipped in packet-aligned mode since every chunk starts on one.
+    if (!deque_.empty()) {
+        Chunk& front_chunk = deque_.front();
+        size_t offset = TsUtils::FindSyncOffset(front_chunk.data_.get() + front_chunk.read_pos_,
+                                                front_chunk.RemainReadable());
+        front_chunk.read_pos_ += offset;
+        readable_bytes_ -= offset;
+        dropped_bytes_ += offset;
+    }
+}
+
+void BlockingBuffer::SkipToSync() {
+    // mutex_ should be held by caller
+    Chunk& front_chunk = deque_.front();
+    size_t remain = front_chunk.RemainReadable();
+    size_t offset = TsUtils::FindSyncOffset(front_chunk.data_.get() + front_chunk.read_pos_, remain);
+
+    front_chunk.read_pos_ += offset;
+    readable_bytes_ -= offset;
+    purged_bytes_ += offset;
+
+    if (offset < remain) {
+        resync_pending_ = false;
+    }
+}
+
+void BlockingBuffer::RefillFromSpill() {
+    // mutex_ should be held by caller
+    bool refilled = false;
+
+    while (spill_.Size() > 0 && deque_.size() < max_chunk_count_) {
+        Chunk chunk = AcquireChunk();
+        size_t bytes = spill_.Read(chunk.data_.get(), chunk_size_);
+
+        if (bytes == 0) {
+            Log::ErrorF("BlockingBuffer::RefillFromSpill(): Reading spill file failed, discarding it");
+            spill_.Clear();
+            RecycleChunk(std::move(chunk));
+            break;
+        }
+
+        chunk.write_pos_ = static_cast<ptrdiff_t>(bytes);
+        deque_.push_back(std::move(chunk));
+        readable_bytes_ += bytes;
+        refilled = true;
+    }
+
+    if (refilled) {
+        // The producer may be waiting for the spill file to drain
+        NotifyProducer();
+    }
+}
+
+void BlockingBuffer::NotifyConsumer(size_t bytes, bool chunk_completed) {
+    // mutex_ should be held by caller
+    if (!consumer_waiting_) {
+        // Nobody to wake up
+        wakeups_avoided_++;
+        return;
+    }
+
+    pending_wakeup_bytes_ += bytes;
+
+    const WakeupPolicy& policy = wakeup_policy_;
+    bool should_wake = false;
+
+    if (policy.bytes == 0 && policy.packets == 0 && !policy.on_chunk_complete && policy.max_delay_ms == 0) {
+        // No coalescing configured, wake on every write
+        should_wake = true;
+    } else if (policy.bytes > 0 && pending_wakeup_bytes_ >= policy.bytes) {
+        should_wake = true;
+    } else if (policy.packets > 0 && pending_wakeup_bytes_ / TsUtils::kPacketSize >= policy.packets) {
+        should_wake = true;
+    } else if (policy.on_chunk_complete && chunk_completed) {
+        should_wake = true;
+    } else if (policy.max_delay_ms > 0) {
+        auto now = std::chrono::steady_clock::now();
+        should_wake = now - last_wakeup_ >= std::chrono::milliseconds(policy.max_delay_ms);
+    }
+
+    if (!should_wake) {
+        wakeups_avoided_++;
+        return;
+    }
+
+    consume_cv_.notify_one();
+    wakeups_sent_++;
+    pending_wakeup_bytes_ = 0;
+
+    if (policy.max_delay_ms > 0) {
+        last_wakeup_ = std::chrono::steady_clock::now();
+    }
+}
+
+void BlockingBuffer::NotifyProducer() {
+    // mutex_ should be held by caller
+    if (producer_waiting_) {
+        produce_cv_.notify_one();
+    }
+}
+
+void BlockingBuffer::ReleaseLeasedChunk() {
+    // mutex_ should be held by caller
+    if (leased_chunk_) {
+        RecycleChunk(std::move(leased_chunk_.value()));
+        leased_chunk_.reset();
+    }
+}
 
-BlockingBuffer::Chunk::Chunk(size_t chunk_size)
-    : chunk_size_(chunk_size), read_pos_(0), write_pos_(0), vec_(chunk_size) {}
 
-BlockingBuffer::Chunk::Chunk(std::vector<uint8_t>&& vec)
-    : chunk_size_(vec.size()), read_pos_(0), write_pos_(vec.size()), vec_(std::move(vec)) {}
+BlockingBuffer::Chunk::Chunk(BufferArena::Ptr&& data, size_t chunk_size)
+    : chunk_size_(chunk_size), read_pos_(0), write_pos_(0), data_(std::move(data)) {}
 
 size_t BlockingBuffer::Chunk::Read(uint8_t* buffer, size_t expected_bytes) {
     assert(buffer != nullptr);
@@ -293,7 +678,7 @@ size_t BlockingBuffer::Chunk::Read(uint8_t* buffer, size_t expected_bytes) {
         return 0;
     }
 
-    uint8_t* read_ptr = vec_.data() + read_pos_;
+    uint8_t* read_ptr = data_.get() + read_pos_;
     memcpy(buffer, read_ptr, expected_bytes);
     read_pos_ += expected_bytes;
 
@@ -311,7 +696,7 @@ size_t BlockingBuffer::Chunk::Write(const uint8_t *buffer, size_t bytes) {
         return 0;
     }
 
-    uint8_t* write_ptr = vec_.data() + write_pos_;
+    uint8_t* write_ptr = data_.get() + write_pos_;
     memcpy(write_ptr, buffer, bytes);
     write_pos_ += bytes;
 
@@ -9,34 +9,56 @@
 #include <cstdint>
 #include <cstring>
 #include <utility>
+#include <memory>
+#include <optional>
+#include <atomic>
 #include <deque>
 #include <vector>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include "buffer_arena.hpp"
+#include "config.hpp"
 #include "noncopyable.hpp"
+#include "spill_file.hpp"
+#include "stream_buffer.hpp"
 
-class BlockingBuffer {
+class BlockingBuffer : public StreamBuffer {
 public:
     explicit BlockingBuffer(size_t chunk_size);
     BlockingBuffer(size_t chunk_size, size_t max_chunk_count);
     BlockingBuffer(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count);
-    ~BlockingBuffer();
-    size_t Read(uint8_t* buffer, size_t expected_bytes);
-    std::pair<uint8_t*, size_t> ReadChunkAndRetain();
-    size_t Write(const uint8_t* buffer, size_t bytes);
+    ~BlockingBuffer() override;
+    size_t Read(uint8_t* buffer, size_t expected_bytes) override;
+    std::pair<uint8_t*, size_t> ReadChunkAndRetain() override;
+    size_t Write(const uint8_t* buffer, size_t bytes) override;
+    // Unsupported, chunks are recycled and reordered under the lock
+    std::pair<uint8_t*, size_t> GetWriteRegion() override;
+    void CommitWrite(size_t bytes) override;
     size_t WriteChunk(const std::vector<uint8_t>& vec);
     size_t WriteChunk(std::vector<uint8_t>&& vec);
-    void WaitUntilData();
-    void WaitUntilEmpty();
-    void NotifyExit();
-    bool IsExit();
-    size_t ReadableBytes();
-    void Clear();
+    void WaitUntilData() override;
+    void WaitUntilEmpty() override;
+    void NotifyExit() override;
+    bool IsExit() override;
+    size_t ReadableBytes() override;
+    size_t WritableBytes() override;
+    void Clear() override;
+    // Also safe against the consumer, the current lease stays valid
+    size_t Purge() override;
+    void SetWakeupPolicy(const WakeupPolicy& policy) override;
+    void SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes) override;
+    // Rounded up to whole chunks
+    void SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) override;
+    size_t PrebufferBytes() override;
+    StreamBufferStats GetStats() override;
+    // Test hook: how many chunk buffers have been allocated from the heap so far,
+    // stays constant during steady-state streaming since consumed chunks are recycled
+    size_t ChunkAllocationCount();
 private:
     struct Chunk {
     public:
-        explicit Chunk(size_t chunk_size);
-        explicit Chunk(std::vector<uint8_t>&& vec);
+        Chunk(BufferArena::Ptr&& data, size_t chunk_size);
         Chunk(Chunk&&) = default;
         Chunk& operator=(Chunk&&) = default;
         size_t Read(uint8_t* buffer, size_t expected_bytes);
@@ -48,20 +70,68 @@ private:
     public:
         ptrdiff_t read_pos_;
         ptrdiff_t write_pos_;
-        std::vector<uint8_t> vec_;
+        BufferArena::Ptr data_;
     private:
         DISALLOW_COPY_AND_ASSIGN(Chunk);
     };
+private:
+    Chunk AcquireChunk();
+    void RecycleChunk(Chunk&& chunk);
+    void RecycleFrontChunk();
+    void ReleaseLeasedChunk();
+    void DropFrontChunk();
+    void RefillFromSpill();
+    void SkipToSync();
+    void NotifyConsumer(size_t bytes, bool chunk_completed);
+    void NotifyProducer();
+    template <typename Predicate>
+    void ConsumerWait(std::unique_lock<std::mutex>& locker, Predicate pred);
+    template <typename Predicate>
+    void ProducerWait(std::unique_lock<std::mutex>& locker, Predicate pred);
+private:
+    static constexpr size_t kDefaultPoolSize = 16;
+    static constexpr uint64_t kDefaultSpillMaxBytes = 512ULL * 1024 * 1024;
 private:
     size_t chunk_size_;
     bool has_chunk_count_limit_;
     size_t max_chunk_count_;
-    size_t min_chunk_count_;
-    bool is_exit_;
+    // Atomic for the lock-free fast path of WaitUntilData()
+    std::atomic<size_t> min_chunk_count_;
+    std::atomic<bool> is_exit_;
+    // Sum of RemainReadable() over deque_, maintained on write/consume
+    std::atomic<size_t> readable_bytes_ = 0;
     std::deque<Chunk> deque_;
+    // Chunk handed out by ReadChunkAndRetain(), detached from deque_ so that neither
+    // the producer nor Clear() can touch it until the consumer comes back
+    std::optional<Chunk> leased_chunk_;
+    // Recycled chunk buffers, never value-initialized
+    std::vector<BufferArena::Ptr> free_chunks_;
+    // A full deque plus the leased chunk, so a drained buffer refills without allocating
+    size_t max_pooled_chunks_;
+    size_t chunk_allocations_ = 0;
     std::mutex mutex_;
     std::condition_variable consume_cv_;
     std::condition_variable produce_cv_;
+
+    WakeupPolicy wakeup_policy_;
+    bool consumer_waiting_ = false;
+    bool producer_waiting_ = false;
+    size_t pending_wakeup_bytes_ = 0;
+    std::chrono::steady_clock::time_point last_wakeup_ = std::chrono::steady_clock::now();
+    uint64_t wakeups_sent_ = 0;
+    uint64_t wakeups_avoided_ = 0;
+    uint64_t spin_hits_ = 0;
+
+    OverflowPolicy overflow_policy_ = kOverflowPolicyBlock;
+    // Bounded by spill_max_bytes, the file never grows beyond that
+    SpillFile spill_{kDefaultSpillMaxBytes};
+    uint64_t discontinuities_ = 0;
+    uint64_t dropped_bytes_ = 0;
+    uint64_t spilled_bytes_ = 0;
+
+    // Set by Purge(), the consumer skips to the next sync byte
+    bool resync_pending_ = false;
+    uint64_t purged_bytes_ = 0;
 private:
     DISALLOW_COPY_AND_ASSIGN(BlockingBuffer);
 };
@@ -2,8 +2,13 @@
 // @author magicxqq <xqq@xqq.im>
 //
 
+#include <algorithm>
+#include <map>
+#include "channel_profiles.hpp"
 #include "log.hpp"
 #include "stream_loader.hpp"
+#include "stream_reactor.hpp"
+#include "stream_reaper.hpp"
 #include "bon_driver.hpp"
 
 BonDriver::BonDriver(const Config& config) : yaml_config_(config), api_(config.GetBaseURL().value(), config.GetVersion().value()) {
@@ -27,9 +32,16 @@ BonDriver::BonDriver(const Config& config) : yaml_config_(config), api_(config.G
 
 BonDriver::~BonDriver() {
     Log::InfoF(LOG_FUNCTION);
-    if (stream_loader_) {
+    if (preconnect_.valid()) {
+        preconnect_.wait();
+    }
+    abandoned_preconnects_.clear();
+    if (stream_loader_ || !standbys_.empty()) {
         CloseTuner();
     }
+    // Streams dropped by SetChannel() may still be shutting down
+    StreamReaper::Instance().Flush();
+    StreamReactor::Instance().Flush();
 }
 
 void BonDriver::Release(void) {
@@ -103,18 +115,33 @@ const BOOL BonDriver::OpenTuner(void) {
         return FALSE;
     }
 
+    if (yaml_config_.GetPreconnect().value_or(true) && !preconnect_.valid()) {
+        // Open the connection the first SetChannel() sends its request on
+        preconnect_ = std::async(std::launch::async, [this, through_reactor = UsesReactor()] {
+            return api_.Preconnect(through_reactor);
+        });
+    }
+
     return TRUE;
 }
 
 void BonDriver::CloseTuner(void) {
     Log::InfoF(LOG_FUNCTION);
 
+    if (outgoing_.has_value()) {
+        CloseStreamLoader(std::move(outgoing_->stream_loader), channels_[outgoing_->channel_index], true);
+        outgoing_.reset();
+    }
+    switch_gap_pending_ = false;
     if (stream_loader_) {
-        if (stream_loader_->IsPolling()) {
-            stream_loader_->Abort();
-        }
-        stream_loader_.reset();
+        CloseStreamLoader(std::move(stream_loader_), current_channel_, true);
     }
+    CloseStandbys();
+    // The host may unload the module right after closing
+    abandoned_preconnects_.clear();
+    StreamReaper::Instance().Flush();
+    StreamReactor::Instance().Flush();
+    ZapLatency::Instance().Dump();
 
     current_channel_ = EPGStation::Channel();
     current_dwspace_ = 0;
@@ -127,6 +154,7 @@ const BOOL BonDriver::SetChannel(const BYTE bCh) {
 
 const BOOL BonDriver::SetChannel(const DWORD dwSpace, const DWORD dwChannel) {
     Log::InfoF("BonDriver::SetChannel(): dwSpace = %u, dwChannel = %u", dwSpace, dwChannel);
+    zap_start_time_ = std::chrono::steady_clock::now();
 
     if (dwSpace >= space_types_.size()) {
         return FALSE;
@@ -145,41 +173,417 @@ const BOOL BonDriver::SetChannel(const DWORD dwSpace, const DWORD dwChannel) {
 
     EPGStation::Channel& channel = channels_[channel_index];
 
+    if (preconnect_.valid()) {
+        // Let the stream go out on the preconnected connection instead of racing the preconnect,
+        // unless the server is slow to answer, then the stream is better off on its own
+        if (preconnect_.wait_for(std::chrono::milliseconds(kPreconnectWaitMs)) == std::future_status::ready) {
+            preconnect_.get();
+        } else {
+            Log::InfoF("BonDriver::SetChannel(): Preconnect still in flight after %d ms, tuning without it",
+                       kPreconnectWaitMs);
+            // Destroying the future would wait for it, drop only those which are done
+            abandoned_preconnects_.erase(std::remove_if(abandoned_preconnects_.begin(), abandoned_preconnects_.end(),
+                                                        [](const std::future<bool>& preconnect) {
+                return preconnect.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }), abandoned_preconnects_.end());
+            abandoned_preconnects_.push_back(std::move(preconnect_));
+        }
+    }
+
+    if (outgoing_.has_value()) {
+        // Superseded before the previous switch completed, move on from whatever the host is watching
+        CompleteSwitch("superseded", false);
+    }
+
+    bool has_standby = std::any_of(standbys_.begin(), standbys_.end(), [channel_index](const Standby& standby) {
+        return standby.channel_index == channel_index && standby.stream_loader->IsPolling();
+    });
+
     if (stream_loader_) {
-        CloseTuner();
+        if (yaml_config_.GetMakeBeforeBreak().has_value() && !has_standby && stream_loader_->IsPolling()) {
+            // The host keeps reading the previous channel until the new stream is readable
+            outgoing_ = Outgoing{current_channel_index_, stream_buffer_type_, zap_start_time_, std::move(stream_loader_)};
+            last_outgoing_read_time_ = zap_start_time_;
+        } else if (yaml_config_.GetStandby().has_value() &&
+                stream_buffer_type_ == kStreamBufferTypeBlocking && stream_loader_->IsPolling()) {
+            // Keep the previous channel around, UpdateStandbys() decides whether it stays
+            ApplyStandbyBuffering(*stream_loader_, current_channel_);
+            standbys_.push_back(Standby{current_channel_index_, true, std::move(stream_loader_)});
+        } else {
+            CloseStreamLoader(std::move(stream_loader_), current_channel_, true);
+        }
     }
 
     current_channel_ = channel;
     current_dwspace_ = dwSpace;
     current_dwchannel_ = dwChannel;
+    current_channel_index_ = channel_index;
+
+    auto standby = std::find_if(standbys_.begin(), standbys_.end(), [channel_index](const Standby& standby) {
+        return standby.channel_index == channel_index;
+    });
+
+    if (standby != standbys_.end() && standby->stream_loader->IsPolling()) {
+        // Promote: the trailing window is delivered right away
+        stream_loader_ = std::move(standby->stream_loader);
+        standbys_.erase(standby);
+        ApplyPrimaryBuffering(*stream_loader_, channel);
+        stream_buffer_type_ = kStreamBufferTypeBlocking;
+        Log::InfoF("BonDriver::SetChannel(): Promoted standby stream, %zu bytes ready", stream_loader_->RemainReadable());
+    } else {
+        if (standby != standbys_.end()) {
+            CloseStreamLoader(std::move(standby->stream_loader), channel, standby->was_primary);
+            standbys_.erase(standby);
+        }
+        stream_loader_ = OpenStreamLoader(channel, false);
+        stream_buffer_type_ = GetStreamSettings(channel).buffer_type;
+    }
+
+    zap_history_.push_back(channel_index);
+    if (zap_history_.size() > kZapHistorySize) {
+        zap_history_.pop_front();
+    }
+
+    if (!outgoing_.has_value()) {
+        // Otherwise deferred to CompleteSwitch(), the previous channel may become a standby itself
+        UpdateStandbys(channel_index);
+    }
+
+    return TRUE;
+}
+
+StreamLoader* BonDriver::GetReadingLoader(bool complete_switch) {
+    if (!outgoing_.has_value()) {
+        return stream_loader_.get();
+    }
+
+    const char* reason = nullptr;
+    StreamLoader& outgoing_loader = *outgoing_->stream_loader;
+    double switch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - outgoing_->switch_start_time).count();
+
+    if (stream_loader_->IsReadable()) {
+        reason = "new stream ready";
+    } else if (!stream_loader_->IsPolling()) {
+        // Let the host see the failure
+        reason = "new stream failed";
+    } else if (!outgoing_loader.IsPolling() && outgoing_loader.RemainReadable() == 0) {
+        reason = "previous stream ended";
+    } else if (switch_ms >= yaml_config_.GetMakeBeforeBreak().value().switch_timeout_ms) {
+        reason = "timeout";
+    }
+
+    if (reason == nullptr) {
+        return &outgoing_loader;
+    }
+    if (complete_switch) {
+        CompleteSwitch(reason, true);
+    }
+    return stream_loader_.get();
+}
+
+void BonDriver::CompleteSwitch(const char* reason, bool update_standbys) {
+    Outgoing outgoing = std::move(outgoing_.value());
+    outgoing_.reset();
+
+    double switch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - outgoing.switch_start_time).count();
+    Log::InfoF("BonDriver::CompleteSwitch(): Switched to %s (%s) after %.1lf ms, %zu bytes of the previous stream dropped",
+               current_channel_.name.c_str(), reason, switch_ms, outgoing.stream_loader->RemainReadable());
+
+    // Both streams deliver whole packets only and the host never gets a partial read,
+    // so the switch between two reads lands on a packet boundary
+    switch_gap_pending_ = true;
+    switch_gap_start_ = last_outgoing_read_time_;
+
+    if (yaml_config_.GetStandby().has_value() &&
+            outgoing.buffer_type == kStreamBufferTypeBlocking && outgoing.stream_loader->IsPolling()) {
+        ApplyStandbyBuffering(*outgoing.stream_loader, channels_[outgoing.channel_index]);
+        standbys_.push_back(Standby{outgoing.channel_index, true, std::move(outgoing.stream_loader)});
+    } else {
+        CloseStreamLoader(std::move(outgoing.stream_loader), channels_[outgoing.channel_index], true);
+    }
+
+    if (update_standbys) {
+        UpdateStandbys(current_channel_index_);
+    }
+}
+
+void BonDriver::OnHostRead(StreamLoader* stream_loader, size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    if (outgoing_.has_value() && stream_loader == outgoing_->stream_loader.get()) {
+        last_outgoing_read_time_ = std::chrono::steady_clock::now();
+    } else if (switch_gap_pending_) {
+        // First data of the new channel, the gap is what the host went without data
+        switch_gap_pending_ = false;
+        double gap_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - switch_gap_start_).count();
+        Log::InfoF("BonDriver::OnHostRead(): Switch gap %.1lf ms", gap_ms);
+        ZapLatency::Instance().RecordSwitchGap(gap_ms);
+    }
+}
+
+BonDriver::StreamSettings BonDriver::GetStreamSettings(const EPGStation::Channel& channel) {
+    StreamSettings settings;
+    settings.buffer_type = yaml_config_.GetBufferType().value_or(kStreamBufferTypeBlocking);
+    settings.chunk_size = chunk_size_;
+    settings.watermarks = yaml_config_.GetBufferWatermarks();
+    settings.kbps = settings.watermarks.value_or(BufferWatermarks()).assumed_kbps;
+
+    if (yaml_config_.GetAdaptiveBuffer().has_value()) {
+        // The buffer follows the measured bitrate while streaming, starting from what has been learned
+        settings.watermarks = settings.watermarks.value_or(BufferWatermarks());
+
+        auto profile = ChannelProfiles::Instance().Get(channel.id);
+        if (profile.has_value()) {
+            BufferGeometry geometry = profile->ToGeometry(settings.watermarks.value(), chunk_size_);
+            settings.chunk_size = geometry.chunk_size;
+            settings.min_chunk_count = geometry.min_chunk_count;
+            settings.watermarks->assumed_kbps = static_cast<int>(profile->kbps);
+            settings.kbps = profile->kbps;
+        }
+    }
+
+    if (settings.watermarks.has_value()) {
+        // Only the ceiling, the actual limits follow the stream bitrate
+        settings.max_chunk_count = std::max<size_t>(settings.watermarks->max_bytes / settings.chunk_size, 1);
+    }
+
+    return settings;
+}
+
+std::unique_ptr<StreamLoader> BonDriver::OpenStreamLoader(const EPGStation::Channel& channel, bool standby) {
+    StreamSettings settings = GetStreamSettings(channel);
+    if (standby) {
+        // Only the blocking buffer can drop the oldest data to keep a trailing window
+        settings.buffer_type = kStreamBufferTypeBlocking;
+    }
+
+    Log::InfoF("BonDriver::OpenStreamLoader(): %s%s, %.0f kbps, chunk size: %zu, chunk count: %zu/%zu",
+               channel.name.c_str(), standby ? " (standby)" : "", settings.kbps,
+               settings.chunk_size, settings.min_chunk_count, settings.max_chunk_count);
+
+    auto stream_loader = std::make_unique<StreamLoader>(settings.buffer_type, settings.chunk_size,
+                                                        settings.max_chunk_count, settings.min_chunk_count);
+    if (standby) {
+        ApplyStandbyBuffering(*stream_loader, channel);
+    } else if (settings.watermarks.has_value()) {
+        stream_loader->SetWatermarks(settings.watermarks.value());
+    }
+    // A make-before-break switch has to land on a packet boundary
+    stream_loader->SetPacketAligned(yaml_config_.GetPacketAligned().value_or(false) ||
+                                    yaml_config_.GetMakeBeforeBreak().has_value());
+    if (yaml_config_.GetSocketTuning().has_value()) {
+        stream_loader->SetSocketTuning(yaml_config_.GetSocketTuning().value());
+    }
+    if (yaml_config_.GetReconnectPolicy().has_value()) {
+        // Implies packet alignment
+        stream_loader->SetReconnectPolicy(yaml_config_.GetReconnectPolicy().value());
+    }
+    stream_loader->SetZeroCopyReceive(yaml_config_.GetZeroCopyReceive().value_or(true));
+    stream_loader->SetUseReactor(UsesReactor());
+    if (!standby && !UsesReactor()) {
+        // Left by a preconnect which has completed, the reactor pools its connection itself
+        std::unique_ptr<cpr::Session> session = api_.TakePreconnectedSession();
+        if (session) {
+            stream_loader->AdoptSession(std::move(session));
+        }
+    }
+    if (yaml_config_.GetBackpressure().has_value()) {
+        stream_loader->SetBackpressure(yaml_config_.GetBackpressure().value());
+    }
+    stream_loader->SetNativeHttp(yaml_config_.GetNativeHttp().value_or(false));
+    if (!standby && yaml_config_.GetOverflowPolicy().has_value()) {
+        stream_loader->SetOverflowPolicy(yaml_config_.GetOverflowPolicy().value(),
+                                         yaml_config_.GetSpillMaxBytes().value_or(512ULL * 1024 * 1024));
+    }
+    if (yaml_config_.GetWakeupPolicy().has_value()) {
+        stream_loader->SetWakeupPolicy(yaml_config_.GetWakeupPolicy().value());
+    }
 
-    stream_loader_ = std::make_unique<StreamLoader>(chunk_size_, 10, 3);
+    if (!standby) {
+        double setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - zap_start_time_).count();
+        stream_loader->SetStartupCallback([channel_id = channel.id, setup_ms](const ZapTimings& timings) {
+            RecordZapLatency(channel_id, setup_ms, timings);
+        });
+    }
 
     std::string path_query = api_.GetMpegtsLiveStreamPathQuery(channel.id, yaml_config_.GetMpegTsStreamingMode().value());
 
-    stream_loader_->Open(yaml_config_.GetBaseURL().value(),
-                         path_query,
-                         yaml_config_.GetBasicAuth(),
-                         yaml_config_.GetUserAgent(),
-                         yaml_config_.GetProxy(),
-                         yaml_config_.GetHeaders());
+    stream_loader->Open(yaml_config_.GetBaseURL().value(),
+                        path_query,
+                        yaml_config_.GetBasicAuth(),
+                        yaml_config_.GetUserAgent(),
+                        yaml_config_.GetProxy(),
+                        yaml_config_.GetHeaders());
 
-    return TRUE;
+    return stream_loader;
+}
+
+bool BonDriver::UsesReactor() {
+    // HTTP/2 streams only multiplex when driven by the same multi handle,
+    // and only a transfer driven by a multi handle can be resumed from the host thread
+    return yaml_config_.GetUseReactor().value_or(false) || yaml_config_.GetHttp2().value_or(false) ||
+           yaml_config_.GetBackpressure().has_value();
+}
+
+void BonDriver::RecordZapLatency(int64_t channel_id, double setup_ms, ZapTimings timings) {
+    // Called on the curl thread, shift the stream's stages onto the SetChannel() timeline
+    for (int stage = kZapStageDns; stage < kZapStageCount; stage++) {
+        timings.stage_ms[stage] += setup_ms;
+    }
+    timings.stage_ms[kZapStageSetup] = setup_ms;
+    ZapLatency::Instance().Record(channel_id, timings);
+}
+
+void BonDriver::CloseStreamLoader(std::unique_ptr<StreamLoader> stream_loader, const EPGStation::Channel& channel, bool update_profile) {
+    // Aborting may take seconds against a half-dead server, never on the caller's thread
+    StreamReaper::Finalizer on_closed;
+    if (update_profile && yaml_config_.GetAdaptiveBuffer().has_value()) {
+        on_closed = [channel_id = channel.id](StreamLoader& closed_loader) {
+            auto profile = closed_loader.GetObservedProfile();
+            if (profile.has_value()) {
+                ChannelProfiles::Instance().Update(channel_id, profile.value());
+            }
+        };
+    }
+    StreamReaper::Instance().Reap(std::move(stream_loader), std::move(on_closed));
+}
+
+void BonDriver::ApplyStandbyBuffering(StreamLoader& stream_loader, const EPGStation::Channel& channel) {
+    StreamSettings settings = GetStreamSettings(channel);
+    int window_ms = yaml_config_.GetStandby().value().window_ms;
+    // Clamped before the conversion, a negative window would not fit in a size_t
+    double window = std::max(settings.kbps / 8 * window_ms, static_cast<double>(settings.chunk_size));
+    size_t window_bytes = static_cast<size_t>(window);
+
+    // Nobody reads a standby stream, keep the freshest data instead of stalling the transfer
+    stream_loader.SetOverflowPolicy(kOverflowPolicyDropOldest, 0);
+    stream_loader.SetCapacity(0, window_bytes);
+}
+
+void BonDriver::ApplyPrimaryBuffering(StreamLoader& stream_loader, const EPGStation::Channel& channel) {
+    StreamSettings settings = GetStreamSettings(channel);
+
+    stream_loader.SetOverflowPolicy(yaml_config_.GetOverflowPolicy().value_or(kOverflowPolicyBlock),
+                                    yaml_config_.GetSpillMaxBytes().value_or(512ULL * 1024 * 1024));
+    if (settings.watermarks.has_value()) {
+        stream_loader.SetWatermarks(settings.watermarks.value());
+    } else {
+        stream_loader.SetCapacity(settings.chunk_size * settings.min_chunk_count,
+                                  settings.chunk_size * settings.max_chunk_count);
+    }
+}
+
+std::vector<size_t> BonDriver::PredictNextChannels(size_t channel_index) {
+    std::vector<size_t> predictions;
+    auto add_prediction = [&](size_t index) {
+        if (index != channel_index && index < channels_.size() &&
+                std::find(predictions.begin(), predictions.end(), index) == predictions.end()) {
+            predictions.push_back(index);
+        }
+    };
+
+    // 1. Back to the last-used channel
+    if (zap_history_.size() >= 2) {
+        add_prediction(zap_history_[zap_history_.size() - 2]);
+    }
+
+    // 2. Where the host went from this channel before, most frequent first
+    std::map<size_t, size_t> next_counts;
+    for (size_t i = 0; i + 1 < zap_history_.size(); i++) {
+        if (zap_history_[i] == channel_index) {
+            next_counts[zap_history_[i + 1]]++;
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> nexts(next_counts.begin(), next_counts.end());
+    std::stable_sort(nexts.begin(), nexts.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+    for (auto& next : nexts) {
+        add_prediction(next.first);
+    }
+
+    // 3. Channel up / down within the current space
+    size_t space_base = space_channel_bases_[current_dwspace_];
+    size_t space_end = current_dwspace_ + 1 < space_channel_bases_.size()
+                       ? space_channel_bases_[current_dwspace_ + 1] : channels_.size();
+    if (channel_index + 1 < space_end) {
+        add_prediction(channel_index + 1);
+    }
+    if (channel_index > space_base) {
+        add_prediction(channel_index - 1);
+    }
+
+    return predictions;
+}
+
+void BonDriver::UpdateStandbys(size_t channel_index) {
+    auto standby_config = yaml_config_.GetStandby();
+    if (!standby_config.has_value()) {
+        return;
+    }
+
+    std::vector<Standby> standbys;
+    double total_kbps = 0;
+
+    for (size_t index : PredictNextChannels(channel_index)) {
+        if (standbys.size() >= standby_config->count) {
+            break;
+        }
+
+        auto iter = std::find_if(standbys_.begin(), standbys_.end(), [index](const Standby& standby) {
+            return standby.channel_index == index && standby.stream_loader->IsPolling();
+        });
+
+        // Measured if already streaming, otherwise learned or assumed
+        double kbps = GetStreamSettings(channels_[index]).kbps;
+        if (iter != standbys_.end() && iter->stream_loader->GetCurrentSpeedKByte() > 0) {
+            kbps = iter->stream_loader->GetCurrentSpeedKByte() * 1024.0 * 8 / 1000;
+        }
+        if (standby_config->max_kbps > 0 && total_kbps + kbps > standby_config->max_kbps) {
+            continue;
+        }
+        total_kbps += kbps;
+
+        if (iter != standbys_.end()) {
+            standbys.push_back(std::move(*iter));
+            standbys_.erase(iter);
+        } else {
+            standbys.push_back(Standby{index, false, OpenStreamLoader(channels_[index], true)});
+        }
+    }
+
+    // Whatever is left has not been predicted or does not fit in the budget
+    CloseStandbys();
+    standbys_ = std::move(standbys);
+
+    Log::InfoF("BonDriver::UpdateStandbys(): %zu standby streams, %.0f kbps", standbys_.size(), total_kbps);
+}
+
+void BonDriver::CloseStandbys() {
+    for (auto& standby : standbys_) {
+        CloseStreamLoader(std::move(standby.stream_loader), channels_[standby.channel_index], standby.was_primary);
+    }
+    standbys_.clear();
 }
 
 const float BonDriver::GetSignalLevel(void) {
-    if (!stream_loader_) {
+    StreamLoader* stream_loader = GetReadingLoader(false);
+    if (!stream_loader) {
         return 0;
     }
-    return stream_loader_->GetCurrentSpeedKByte() * 8 / 1000.0f;
+    return stream_loader->GetCurrentSpeedKByte() * 8 / 1000.0f;
 }
 
 const DWORD BonDriver::WaitTsStream(const DWORD dwTimeOut) {
-    if (!stream_loader_) {
+    // The switch itself is left to GetTsStream(), the host may still hold a chunk of the previous stream
+    StreamLoader* stream_loader = GetReadingLoader(false);
+    if (!stream_loader) {
         return WAIT_ABANDONED;
     }
 
-    auto wait_result = stream_loader_->WaitForResponse(std::chrono::milliseconds(dwTimeOut));
+    auto wait_result = stream_loader->WaitForResponse(std::chrono::milliseconds(dwTimeOut));
     if (wait_result == StreamLoader::WaitResult::kWaitFailed) {
         return WAIT_FAILED;
     } else if (wait_result == StreamLoader::WaitResult::kWaitTimeout) {
@@ -189,7 +593,7 @@ const DWORD BonDriver::WaitTsStream(const DWORD dwTimeOut) {
         return WAIT_ABANDONED;
     } // else: wait_result == WaitResult::kResultOK
 
-    wait_result = stream_loader_->WaitForData();
+    wait_result = stream_loader->WaitForData();
     if (wait_result == StreamLoader::WaitResult::kWaitFailed) {
         return WAIT_FAILED;
     } else if (wait_result == StreamLoader::WaitResult::kResultFailed) {
@@ -200,53 +604,65 @@ const DWORD BonDriver::WaitTsStream(const DWORD dwTimeOut) {
 }
 
 const DWORD BonDriver::GetReadyCount(void) {
-    if (!stream_loader_) {
+    StreamLoader* stream_loader = GetReadingLoader(false);
+    if (!stream_loader) {
         return 0;
     }
 
-    return static_cast<DWORD>(stream_loader_->RemainReadable());
+    return static_cast<DWORD>(stream_loader->RemainReadable());
 }
 
 const BOOL BonDriver::GetTsStream(BYTE *pDst, DWORD *pdwSize, DWORD *pdwRemain) {
-    if (!stream_loader_ || !stream_loader_->IsPolling()) {
+    StreamLoader* stream_loader = GetReadingLoader(true);
+    if (!stream_loader || !stream_loader->IsPolling()) {
         return FALSE;
     }
 
-    if (stream_loader_->RemainReadable() == 0) {
+    if (stream_loader->RemainReadable() == 0) {
         *pdwSize = 0;
         *pdwRemain = 0;
         return TRUE;
     }
 
-    size_t bytes_read = stream_loader_->Read(static_cast<uint8_t*>(pDst), chunk_size_);
+    size_t bytes_read = stream_loader->Read(static_cast<uint8_t*>(pDst), chunk_size_);
     *pdwSize = static_cast<DWORD>(bytes_read);
-    *pdwRemain = static_cast<DWORD>(stream_loader_->RemainReadable());
+    *pdwRemain = static_cast<DWORD>(stream_loader->RemainReadable());
+    OnHostRead(stream_loader, bytes_read);
 
     return TRUE;
 }
 
 const BOOL BonDriver::GetTsStream(BYTE **ppDst, DWORD *pdwSize, DWORD *pdwRemain) {
-    if (!stream_loader_ || !stream_loader_->IsPolling()) {
+    StreamLoader* stream_loader = GetReadingLoader(true);
+    if (!stream_loader || !stream_loader->IsPolling()) {
         return FALSE;
     }
 
-    if (stream_loader_->RemainReadable() == 0) {
+    if (stream_loader->RemainReadable() == 0) {
         *pdwSize = 0;
         *pdwRemain = 0;
         return TRUE;
     }
 
-    std::pair<uint8_t*, size_t> data = stream_loader_->ReadChunkAndRetain();
+    // The returned buffer is leased from the stream buffer and stays valid until the next GetTsStream() call
+    std::pair<uint8_t*, size_t> data = stream_loader->ReadChunkAndRetain();
 
     *ppDst = data.first;
     *pdwSize = static_cast<DWORD>(data.second);
-    *pdwRemain = static_cast<DWORD>(stream_loader_->RemainReadable());
+    *pdwRemain = static_cast<DWORD>(stream_loader->RemainReadable());
+    OnHostRead(stream_loader, data.second);
 
     return TRUE;
 }
 
 void BonDriver::PurgeTsStream(void) {
-    // do nothing
+    // Completing the switch here would reap the outgoing loader while the host still holds
+    // the chunk GetTsStream() lent it, leave that to the next GetTsStream()
+    StreamLoader* stream_loader = GetReadingLoader(false);
+    if (!stream_loader) {
+        return;
+    }
+    stream_loader->Purge();
 }
 
 LPCTSTR BonDriver::GetTunerName(void) {
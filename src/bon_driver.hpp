@@ -6,13 +6,18 @@
 #define BONDRIVER_EPGSTATION_BON_DRIVER_HPP
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <unordered_set>
 #include <memory>
+#include <future>
+#include <optional>
+#include <chrono>
 #include "IBonDriver2.h"
 #include "config.hpp"
 #include "epgstation_models.hpp"
 #include "epgstation_api.hpp"
+#include "zap_latency.hpp"
 
 class StreamLoader;
 
@@ -40,8 +45,55 @@ protected:
     const BOOL SetChannel(const DWORD dwSpace, const DWORD dwChannel) override;
     const DWORD GetCurSpace(void) override;
     const DWORD GetCurChannel(void) override;
+private:
+    // How a stream of a channel is buffered
+    struct StreamSettings {
+        StreamBufferType buffer_type = kStreamBufferTypeBlocking;
+        size_t chunk_size = 0;
+        size_t max_chunk_count = 10;
+        size_t min_chunk_count = 3;
+        std::optional<BufferWatermarks> watermarks;
+        // Learned or assumed bitrate
+        double kbps = 0;
+    };
+
+    // A stream kept open on a channel likely to be tuned next
+    struct Standby {
+        size_t channel_index = 0;
+        // Has been streamed to the host, its profile is learned once closed
+        bool was_primary = false;
+        std::unique_ptr<StreamLoader> stream_loader;
+    };
+
+    // The previous channel, still read by the host until the new stream is readable
+    struct Outgoing {
+        size_t channel_index = 0;
+        StreamBufferType buffer_type = kStreamBufferTypeBlocking;
+        std::chrono::steady_clock::time_point switch_start_time;
+        std::unique_ptr<StreamLoader> stream_loader;
+    };
 private:
     void InitChannels();
+    StreamSettings GetStreamSettings(const EPGStation::Channel& channel);
+    std::unique_ptr<StreamLoader> OpenStreamLoader(const EPGStation::Channel& channel, bool standby);
+    bool UsesReactor();
+    static void RecordZapLatency(int64_t channel_id, double setup_ms, ZapTimings timings);
+    void CloseStreamLoader(std::unique_ptr<StreamLoader> stream_loader, const EPGStation::Channel& channel, bool update_profile);
+    // Switch a loader between the standby (trailing window, drop oldest) and the primary buffering
+    void ApplyStandbyBuffering(StreamLoader& stream_loader, const EPGStation::Channel& channel);
+    void ApplyPrimaryBuffering(StreamLoader& stream_loader, const EPGStation::Channel& channel);
+    std::vector<size_t> PredictNextChannels(size_t channel_index);
+    void UpdateStandbys(size_t channel_index);
+    void CloseStandbys();
+    // The stream the host reads from, past a make-before-break switch once it is due.
+    // Only GetTsStream() may complete the switch, the host may hold a chunk leased from the previous stream.
+    StreamLoader* GetReadingLoader(bool complete_switch);
+    void CompleteSwitch(const char* reason, bool update_standbys);
+    void OnHostRead(StreamLoader* stream_loader, size_t bytes);
+private:
+    static constexpr size_t kZapHistorySize = 64;
+    // How long SetChannel() lets a preconnect still in flight finish before tuning without it
+    static constexpr int kPreconnectWaitMs = 300;
 private:
     const Config& yaml_config_;
     EPGStationAPI api_;
@@ -51,11 +103,30 @@ private:
     std::vector<EPGStation::Channel> channels_;
 
     size_t chunk_size_ = 188 * 1024;
+    // Opens a connection between OpenTuner() and the first SetChannel()
+    std::future<bool> preconnect_;
+    // Preconnects SetChannel() gave up waiting for, kept so that their destructors don't block it.
+    // Waited for by CloseTuner().
+    std::vector<std::future<bool>> abandoned_preconnects_;
     std::unique_ptr<StreamLoader> stream_loader_;
+    StreamBufferType stream_buffer_type_ = kStreamBufferTypeBlocking;
 
     EPGStation::Channel current_channel_;
     DWORD current_dwspace_ = 0;
     DWORD current_dwchannel_ = 0;
+    size_t current_channel_index_ = 0;
+    // Entry of the SetChannel() in progress, the origin of the zap latency stages
+    std::chrono::steady_clock::time_point zap_start_time_;
+
+    std::optional<Outgoing> outgoing_;
+    // Host side of the switch, only touched from the host thread
+    std::chrono::steady_clock::time_point last_outgoing_read_time_;
+    bool switch_gap_pending_ = false;
+    std::chrono::steady_clock::time_point switch_gap_start_;
+
+    std::vector<Standby> standbys_;
+    // Tuned channel indexes, the most recent last
+    std::deque<size_t> zap_history_;
 
     std::unordered_set<std::string> space_set_;
     std::vector<std::string> space_types_;
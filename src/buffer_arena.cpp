@@ -0,0 +1,211 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+#include "log.hpp"
+#include "buffer_arena.hpp"
+
+#ifdef _WIN32
+static bool EnableLockMemoryPrivilege() {
+    // Large pages require SeLockMemoryPrivilege, which has to be granted by the administrator
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool succeeded = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+                     AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                     GetLastError() == ERROR_SUCCESS;  // ERROR_NOT_ALL_ASSIGNED if not granted
+
+    CloseHandle(token);
+    return succeeded;
+}
+#endif
+
+void BufferArena::Deleter::operator()(uint8_t* ptr) const {
+    BufferArena& arena = BufferArena::Instance();
+
+    if (arena.Contains(ptr)) {
+        arena.Free(ptr, bytes);
+    } else {
+        delete[] ptr;
+    }
+}
+
+BufferArena& BufferArena::Instance() {
+    // Intentionally leaked, see ~BufferArena()
+    static BufferArena* instance = new BufferArena();
+    return *instance;
+}
+
+void BufferArena::Init(const BufferArenaConfig& config) {
+    std::lock_guard guard(mutex_);
+
+    if (initialized_) {
+        return;
+    }
+    initialized_ = true;
+
+    if (config.size_bytes == 0) {
+        return;
+    }
+
+    if (!Map(config.size_bytes, config.huge_pages)) {
+        Log::ErrorF("BufferArena::Init(): Mapping %zu bytes failed, stream buffers use the heap",
+                    config.size_bytes);
+        return;
+    }
+
+    if (config.lock) {
+        if (huge_pages_) {
+            // Large pages are never paged out anyway
+        } else if (Lock()) {
+            locked_ = true;
+        } else {
+            Log::ErrorF("BufferArena::Init(): Locking the arena is not permitted, it stays pageable");
+        }
+    }
+
+    Log::InfoF("BufferArena::Init(): Arena size: %zu KiB, huge pages: %s, locked: %s",
+               capacity_ / 1024,
+               huge_pages_ ? "yes" : "no",
+               (locked_ || huge_pages_) ? "yes" : "no");
+}
+
+BufferArena::Ptr BufferArena::Allocate(size_t bytes) {
+    size_t slot_size = RoundUp(bytes, kSlotAlignment);
+
+    {
+        std::lock_guard guard(mutex_);
+
+        auto iter = free_slots_.find(slot_size);
+        if (iter != free_slots_.end() && !iter->second.empty()) {
+            uint8_t* ptr = iter->second.back();
+            iter->second.pop_back();
+            return Ptr(ptr, Deleter{bytes});
+        }
+
+        if (base_ && capacity_ - offset_ >= slot_size) {
+            uint8_t* ptr = base_ + offset_;
+            offset_ += slot_size;
+            return Ptr(ptr, Deleter{bytes});
+        }
+
+        if (base_) {
+            heap_fallbacks_++;
+        }
+    }
+
+    // new uint8_t[] without () leaves the memory uninitialized, avoiding a useless memset
+    return Ptr(new uint8_t[bytes], Deleter{bytes});
+}
+
+size_t BufferArena::Capacity() {
+    std::lock_guard guard(mutex_);
+    return capacity_;
+}
+
+size_t BufferArena::HeapFallbackCount() {
+    std::lock_guard guard(mutex_);
+    return heap_fallbacks_;
+}
+
+bool BufferArena::Contains(const uint8_t* ptr) const {
+    // base_ and capacity_ are only written once, in Init()
+    return base_ != nullptr && ptr >= base_ && ptr < base_ + capacity_;
+}
+
+void BufferArena::Free(uint8_t* ptr, size_t bytes) {
+    std::lock_guard guard(mutex_);
+    free_slots_[RoundUp(bytes, kSlotAlignment)].push_back(ptr);
+}
+
+bool BufferArena::Map(size_t bytes, bool huge_pages) {
+    // mutex_ should be held by caller
+#ifdef _WIN32
+    if (huge_pages) {
+        size_t large_page_size = GetLargePageMinimum();
+        if (large_page_size > 0 && EnableLockMemoryPrivilege()) {
+            size_t size = RoundUp(bytes, large_page_size);
+            void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (ptr) {
+                base_ = static_cast<uint8_t*>(ptr);
+                capacity_ = size;
+                huge_pages_ = true;
+                return true;
+            }
+        }
+        Log::InfoF("BufferArena::Map(): Large pages are not available, fall back to regular pages");
+    }
+
+    size_t size = RoundUp(bytes, kSlotAlignment);
+    void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!ptr) {
+        return false;
+    }
+#else
+    void* ptr = MAP_FAILED;
+    size_t size = RoundUp(bytes, kSlotAlignment);
+
+  #ifdef MAP_HUGETLB
+    if (huge_pages) {
+        // Explicit huge pages need a reserved hugetlbfs pool
+        size_t huge_size = RoundUp(bytes, 2 * 1024 * 1024);
+        ptr = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            base_ = static_cast<uint8_t*>(ptr);
+            capacity_ = huge_size;
+            huge_pages_ = true;
+            return true;
+        }
+    }
+  #endif
+
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+  #ifdef MADV_HUGEPAGE
+    if (huge_pages && madvise(ptr, size, MADV_HUGEPAGE) == 0) {
+        // Transparent huge pages, best effort
+        Log::InfoF("BufferArena::Map(): Explicit huge pages are not available, using transparent huge pages");
+    }
+  #endif
+#endif
+
+    base_ = static_cast<uint8_t*>(ptr);
+    capacity_ = size;
+    return true;
+}
+
+bool BufferArena::Lock() {
+    // mutex_ should be held by caller
+#ifdef _WIN32
+    // VirtualLock() is bounded by the minimum working set size
+    SIZE_T min_working_set = 0;
+    SIZE_T max_working_set = 0;
+    if (!GetProcessWorkingSetSize(GetCurrentProcess(), &min_working_set, &max_working_set)) {
+        return false;
+    }
+    if (!SetProcessWorkingSetSize(GetCurrentProcess(), min_working_set + capacity_, max_working_set + capacity_)) {
+        return false;
+    }
+    return VirtualLock(base_, capacity_) != 0;
+#else
+    return mlock(base_, capacity_) == 0;
+#endif
+}
+
+size_t BufferArena::RoundUp(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
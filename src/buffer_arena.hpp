@@ -0,0 +1,62 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_BUFFER_ARENA_HPP
+#define BONDRIVER_EPGSTATION_BUFFER_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "config.hpp"
+#include "noncopyable.hpp"
+
+// Process-wide region backing the stream buffers of all tuners, optionally mapped with
+// huge pages and locked into RAM. Allocations are carved out in page-aligned slots and
+// recycled per size. Whenever the arena is disabled or exhausted, memory comes from the heap.
+class BufferArena {
+public:
+    struct Deleter {
+        size_t bytes = 0;
+        void operator()(uint8_t* ptr) const;
+    };
+    using Ptr = std::unique_ptr<uint8_t[], Deleter>;
+public:
+    static BufferArena& Instance();
+    // Map the arena, only the first call has effect
+    void Init(const BufferArenaConfig& config);
+    // Uninitialized memory, like new uint8_t[]
+    Ptr Allocate(size_t bytes);
+    size_t Capacity();
+    size_t HeapFallbackCount();
+private:
+    BufferArena() = default;
+    // Never unmapped: buffers may still be alive during static destruction
+    ~BufferArena() = default;
+    bool Contains(const uint8_t* ptr) const;
+    void Free(uint8_t* ptr, size_t bytes);
+    bool Map(size_t bytes, bool huge_pages);
+    bool Lock();
+    static size_t RoundUp(size_t bytes, size_t alignment);
+private:
+    static constexpr size_t kSlotAlignment = 4096;
+private:
+    std::mutex mutex_;
+    bool initialized_ = false;
+    uint8_t* base_ = nullptr;
+    size_t capacity_ = 0;
+    // Bump pointer for slots which have never been handed out
+    size_t offset_ = 0;
+    std::unordered_map<size_t, std::vector<uint8_t*>> free_slots_;
+    bool huge_pages_ = false;
+    bool locked_ = false;
+    size_t heap_fallbacks_ = 0;
+private:
+    DISALLOW_COPY_AND_ASSIGN(BufferArena);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_BUFFER_ARENA_HPP
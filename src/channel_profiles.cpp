@@ -0,0 +1,157 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <unistd.h>
+#endif
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <yaml-cpp/yaml.h>
+#include "log.hpp"
+#include "ts_utils.hpp"
+#include "channel_profiles.hpp"
+
+// Chunks smaller than this only add per-chunk overhead
+static constexpr size_t kMinChunkSize = TsUtils::kPacketSize * 16;
+// Used when the host's read cadence is unknown
+static constexpr double kDefaultChunkMs = 100;
+
+BufferGeometry ChannelProfile::ToGeometry(const BufferWatermarks& watermarks, size_t max_chunk_size) const {
+    double bytes_per_ms = kbps / 8;
+    double chunk_ms = drain_interval_ms > 0 ? drain_interval_ms : kDefaultChunkMs;
+
+    size_t chunk_size = static_cast<size_t>(bytes_per_ms * chunk_ms);
+    chunk_size = chunk_size / TsUtils::kPacketSize * TsUtils::kPacketSize;
+    chunk_size = std::clamp(chunk_size, kMinChunkSize, std::max(max_chunk_size, kMinChunkSize));
+
+    size_t max_count_limit = std::max<size_t>(watermarks.max_bytes / chunk_size, 1);
+    auto chunks_for = [bytes_per_ms, chunk_size](int ms) {
+        return static_cast<size_t>(std::ceil(bytes_per_ms * ms / static_cast<double>(chunk_size)));
+    };
+
+    BufferGeometry geometry;
+    geometry.chunk_size = chunk_size;
+    geometry.max_chunk_count = std::clamp<size_t>(chunks_for(watermarks.capacity_ms), 1, max_count_limit);
+    geometry.min_chunk_count = std::min(chunks_for(watermarks.prebuffer_ms), geometry.max_chunk_count);
+    return geometry;
+}
+
+ChannelProfiles& ChannelProfiles::Instance() {
+    static ChannelProfiles instance;
+    return instance;
+}
+
+void ChannelProfiles::Load(const std::string& filename) {
+    std::lock_guard guard(mutex_);
+
+    if (loaded_) {
+        return;
+    }
+    loaded_ = true;
+    filename_ = filename;
+
+    try {
+        YAML::Node root = YAML::LoadFile(filename);
+        const YAML::Node& channels = root["channels"];
+        if (!channels.IsMap()) {
+            return;
+        }
+
+        for (const auto& entry : channels) {
+            ChannelProfile profile;
+            profile.kbps = entry.second["kbps"].as<double>(0);
+            profile.drain_interval_ms = entry.second["drainIntervalMs"].as<double>(0);
+            if (profile.kbps > 0) {
+                profiles_[entry.first.as<int64_t>()] = profile;
+            }
+        }
+    } catch (YAML::BadFile&) {
+        // Not created yet
+    } catch (YAML::Exception& ex) {
+        Log::ErrorF("ChannelProfiles::Load(): Parse %s failed, %s", filename.c_str(), ex.what());
+        profiles_.clear();
+    }
+
+    Log::InfoF("ChannelProfiles::Load(): %zu channel profiles loaded", profiles_.size());
+}
+
+std::optional<ChannelProfile> ChannelProfiles::Get(int64_t channel_id) {
+    std::lock_guard guard(mutex_);
+
+    auto iter = profiles_.find(channel_id);
+    if (iter == profiles_.end()) {
+        return std::nullopt;
+    }
+    return iter->second;
+}
+
+void ChannelProfiles::Update(int64_t channel_id, const ChannelProfile& observed) {
+    std::lock_guard guard(mutex_);
+
+    auto iter = profiles_.find(channel_id);
+    if (iter == profiles_.end()) {
+        profiles_[channel_id] = observed;
+    } else {
+        ChannelProfile& profile = iter->second;
+        profile.kbps += (observed.kbps - profile.kbps) * kBlendFactor;
+        if (observed.drain_interval_ms > 0) {
+            profile.drain_interval_ms += (observed.drain_interval_ms - profile.drain_interval_ms) * kBlendFactor;
+        }
+    }
+
+    if (!filename_.empty() && !Save()) {
+        Log::ErrorF("ChannelProfiles::Update(): Saving %s failed", filename_.c_str());
+    }
+}
+
+bool ChannelProfiles::Save() {
+    // mutex_ should be held by caller
+    YAML::Emitter emitter;
+    emitter << YAML::BeginMap << YAML::Key << "channels" << YAML::Value << YAML::BeginMap;
+    for (const auto& [channel_id, profile] : profiles_) {
+        emitter << YAML::Key << channel_id << YAML::Value << YAML::BeginMap
+                << YAML::Key << "kbps" << YAML::Value << profile.kbps
+                << YAML::Key << "drainIntervalMs" << YAML::Value << profile.drain_interval_ms
+                << YAML::EndMap;
+    }
+    emitter << YAML::EndMap << YAML::EndMap;
+
+    // Written aside and renamed over the profile file, so that a crash or another process
+    // loading it never sees a half-written file. The process id keeps the temp files of
+    // several processes sharing the profile file apart.
+#ifdef _WIN32
+    std::string temp_filename = filename_ + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+    std::string temp_filename = filename_ + "." + std::to_string(getpid()) + ".tmp";
+#endif
+
+    {
+        std::ofstream file(temp_filename, std::ios::out | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << emitter.c_str() << std::endl;
+        file.close();
+        if (!file) {
+            std::remove(temp_filename.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename() refuses to replace an existing file on Windows
+    bool renamed = MoveFileExA(temp_filename.c_str(), filename_.c_str(),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool renamed = std::rename(temp_filename.c_str(), filename_.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::remove(temp_filename.c_str());
+    }
+    return renamed;
+}
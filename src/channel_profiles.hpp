@@ -0,0 +1,60 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_CHANNEL_PROFILES_HPP
+#define BONDRIVER_EPGSTATION_CHANNEL_PROFILES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <map>
+#include <mutex>
+#include "config.hpp"
+#include "noncopyable.hpp"
+
+struct BufferGeometry {
+    size_t chunk_size = 0;
+    size_t max_chunk_count = 0;
+    size_t min_chunk_count = 0;
+};
+
+// What has been observed while streaming a channel
+struct ChannelProfile {
+    double kbps = 0;
+    // Average interval between two reads of the host
+    double drain_interval_ms = 0;
+
+    // Chunks hold what arrives between two reads of the host, counts follow the watermarks.
+    // chunk_size is a multiple of the TS packet size, no larger than max_chunk_size.
+    [[nodiscard]] BufferGeometry ToGeometry(const BufferWatermarks& watermarks, size_t max_chunk_size) const;
+};
+
+// Learned per-channel profiles keyed by Channel::id, persisted as a YAML file
+// so that the next tune of a channel starts with the right buffer geometry.
+// Shared by every tuner in the process.
+class ChannelProfiles {
+public:
+    static ChannelProfiles& Instance();
+    // Only the first call has effect
+    void Load(const std::string& filename);
+    std::optional<ChannelProfile> Get(int64_t channel_id);
+    // Blend the observation into the stored profile and save the file
+    void Update(int64_t channel_id, const ChannelProfile& observed);
+private:
+    ChannelProfiles() = default;
+    bool Save();
+private:
+    static constexpr double kBlendFactor = 0.5;
+private:
+    std::mutex mutex_;
+    bool loaded_ = false;
+    std::string filename_;
+    std::map<int64_t, ChannelProfile> profiles_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(ChannelProfiles);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_CHANNEL_PROFILES_HPP
@@ -0,0 +1,137 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstring>
+#include <algorithm>
+#include "chunked_decoder.hpp"
+
+void ChunkedDecoder::Reset() {
+    state_ = State::kSize;
+    chunk_remaining_ = 0;
+    size_digits_ = 0;
+    trailer_line_bytes_ = 0;
+}
+
+size_t ChunkedDecoder::Decode(uint8_t* data, size_t bytes) {
+    // The payload is compacted towards the start of the region, over the framing already consumed
+    uint8_t* out = data;
+    const uint8_t* in = data;
+    const uint8_t* end = data + bytes;
+
+    while (in < end) {
+        switch (state_) {
+            case State::kSize: {
+                uint8_t c = *in++;
+                int digit = -1;
+                if (c >= '0' && c <= '9') {
+                    digit = c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    digit = c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    digit = c - 'A' + 10;
+                }
+
+                if (digit >= 0) {
+                    if (chunk_remaining_ >> 60) {
+                        state_ = State::kError;
+                        break;
+                    }
+                    chunk_remaining_ = chunk_remaining_ * 16 + digit;
+                    size_digits_++;
+                } else if (size_digits_ == 0) {
+                    // A size line without a size
+                    state_ = State::kError;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    state_ = State::kExtension;
+                } else if (c == '\r') {
+                    state_ = State::kSizeLF;
+                } else if (c == '\n') {
+                    state_ = StateAfterSize();
+                } else {
+                    state_ = State::kError;
+                }
+                break;
+            }
+            case State::kExtension: {
+                uint8_t c = *in++;
+                if (c == '\r') {
+                    state_ = State::kSizeLF;
+                } else if (c == '\n') {
+                    state_ = StateAfterSize();
+                }
+                break;
+            }
+            case State::kSizeLF:
+                if (*in++ != '\n') {
+                    state_ = State::kError;
+                    break;
+                }
+                state_ = StateAfterSize();
+                break;
+            case State::kData: {
+                size_t run = static_cast<size_t>(std::min<uint64_t>(chunk_remaining_, end - in));
+                if (out != in) {
+                    memmove(out, in, run);
+                }
+                out += run;
+                in += run;
+                chunk_remaining_ -= run;
+                if (chunk_remaining_ == 0) {
+                    size_digits_ = 0;
+                    state_ = State::kDataCR;
+                }
+                break;
+            }
+            case State::kDataCR: {
+                uint8_t c = *in++;
+                if (c == '\r') {
+                    state_ = State::kDataLF;
+                } else if (c == '\n') {
+                    state_ = State::kSize;
+                } else {
+                    state_ = State::kError;
+                }
+                break;
+            }
+            case State::kDataLF:
+                if (*in++ != '\n') {
+                    state_ = State::kError;
+                    break;
+                }
+                state_ = State::kSize;
+                break;
+            case State::kTrailer: {
+                // Trailer fields are ignored, an empty line ends the message
+                uint8_t c = *in++;
+                if (c == '\n') {
+                    if (trailer_line_bytes_ == 0) {
+                        state_ = State::kDone;
+                    }
+                    trailer_line_bytes_ = 0;
+                } else if (c != '\r') {
+                    trailer_line_bytes_++;
+                }
+                break;
+            }
+            case State::kDone:
+            case State::kError:
+                in = end;
+                break;
+        }
+    }
+
+    return out - data;
+}
+
+bool ChunkedDecoder::IsDone() const {
+    return state_ == State::kDone;
+}
+
+bool ChunkedDecoder::IsError() const {
+    return state_ == State::kError;
+}
+
+ChunkedDecoder::State ChunkedDecoder::StateAfterSize() const {
+    return chunk_remaining_ > 0 ? State::kData : State::kTrailer;
+}
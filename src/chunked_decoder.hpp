@@ -0,0 +1,46 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_CHUNKED_DECODER_HPP
+#define BONDRIVER_EPGSTATION_CHUNKED_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Incremental decoder of the chunked transfer coding, working in place on what recv() returned.
+// The input may be split anywhere, chunk extensions and trailer fields are skipped.
+class ChunkedDecoder {
+public:
+    // Start over for a new message
+    void Reset();
+    // Strips the framing of the bytes just received in place, returns the payload size.
+    // The payload is compacted towards data, nothing is consumed once done or failed.
+    size_t Decode(uint8_t* data, size_t bytes);
+    // The last chunk and the trailer section have been received
+    bool IsDone() const;
+    bool IsError() const;
+private:
+    enum class State {
+        kSize,
+        kExtension,
+        kSizeLF,
+        kData,
+        kDataCR,
+        kDataLF,
+        kTrailer,
+        kDone,
+        kError
+    };
+private:
+    // After the size line, a zero size is the last chunk
+    State StateAfterSize() const;
+private:
+    State state_ = State::kSize;
+    uint64_t chunk_remaining_ = 0;
+    size_t size_digits_ = 0;
+    size_t trailer_line_bytes_ = 0;
+};
+
+
+#endif // BONDRIVER_EPGSTATION_CHUNKED_DECODER_HPP
@@ -2,6 +2,8 @@
 // @author magicxqq <xqq@xqq.im>
 //
 
+#include <algorithm>
+#include <limits>
 #include <yaml-cpp/yaml.h>
 #include "log.hpp"
 #include "string_utils.hpp"
@@ -86,6 +88,290 @@ bool Config::LoadYamlFile(const std::string& filename) {
             }
         } // else: headers is optional
 
+        if (config["bufferType"]) {
+            std::string buffer_type_desc = config["bufferType"].as<std::string>();
+            if (buffer_type_desc == "blocking") {
+                buffer_type_ = kStreamBufferTypeBlocking;
+            } else if (buffer_type_desc == "ring") {
+                buffer_type_ = kStreamBufferTypeRing;
+            } else {
+                Log::ErrorF("Incorrect bufferType: %s", buffer_type_desc.c_str());
+                return false;
+            }
+        } // else: bufferType is optional
+
+        if (config["packetAligned"]) {
+            packet_aligned_ = config["packetAligned"].as<bool>();
+        } // else: packetAligned is optional
+
+        if (config["wakeup"]) {
+            const YAML::Node& wakeup_node = config["wakeup"];
+            if (!wakeup_node.IsMap()) {
+                Log::ErrorF("wakeup field must be a map");
+                return false;
+            }
+
+            // Signed, so that a negative threshold is rejected rather than wrapped around,
+            // and 64-bit, so that one past a 32-bit size_t is too
+            int64_t wakeup_bytes = wakeup_node["bytes"].as<int64_t>(0);
+            int64_t wakeup_packets = wakeup_node["packets"].as<int64_t>(0);
+
+            WakeupPolicy wakeup_policy;
+            if (wakeup_node["chunkComplete"]) {
+                wakeup_policy.on_chunk_complete = wakeup_node["chunkComplete"].as<bool>();
+            }
+            if (wakeup_node["maxDelayMs"]) {
+                wakeup_policy.max_delay_ms = wakeup_node["maxDelayMs"].as<int>();
+            }
+            if (wakeup_node["spinCount"]) {
+                wakeup_policy.spin_count = wakeup_node["spinCount"].as<int>();
+            }
+
+            constexpr uint64_t kMaxSize = std::numeric_limits<size_t>::max();
+            if (wakeup_bytes < 0 || static_cast<uint64_t>(wakeup_bytes) > kMaxSize ||
+                wakeup_packets < 0 || static_cast<uint64_t>(wakeup_packets) > kMaxSize ||
+                wakeup_policy.max_delay_ms < 0 || wakeup_policy.spin_count < 0) {
+                Log::ErrorF("Incorrect wakeup");
+                return false;
+            }
+
+            wakeup_policy.bytes = static_cast<size_t>(wakeup_bytes);
+            wakeup_policy.packets = static_cast<size_t>(wakeup_packets);
+            wakeup_policy_ = wakeup_policy;
+        } // else: wakeup is optional
+
+        if (config["arena"]) {
+            const YAML::Node& arena_node = config["arena"];
+            if (!arena_node.IsMap()) {
+                Log::ErrorF("arena field must be a map");
+                return false;
+            }
+
+            BufferArenaConfig buffer_arena;
+            if (arena_node["sizeMB"]) {
+                buffer_arena.size_bytes = arena_node["sizeMB"].as<size_t>() * 1024 * 1024;
+            }
+            if (arena_node["hugePages"]) {
+                buffer_arena.huge_pages = arena_node["hugePages"].as<bool>();
+            }
+            if (arena_node["lock"]) {
+                buffer_arena.lock = arena_node["lock"].as<bool>();
+            }
+
+            buffer_arena_ = buffer_arena;
+        } // else: arena is optional
+
+        if (config["watermarks"]) {
+            const YAML::Node& watermarks_node = config["watermarks"];
+            if (!watermarks_node.IsMap()) {
+                Log::ErrorF("watermarks field must be a map");
+                return false;
+            }
+
+            BufferWatermarks buffer_watermarks;
+            if (watermarks_node["prebufferMs"]) {
+                buffer_watermarks.prebuffer_ms = watermarks_node["prebufferMs"].as<int>();
+            }
+            if (watermarks_node["capacityMs"]) {
+                buffer_watermarks.capacity_ms = watermarks_node["capacityMs"].as<int>();
+            }
+            if (watermarks_node["maxMB"]) {
+                buffer_watermarks.max_bytes = watermarks_node["maxMB"].as<size_t>() * 1024 * 1024;
+            }
+            if (watermarks_node["assumedKbps"]) {
+                buffer_watermarks.assumed_kbps = watermarks_node["assumedKbps"].as<int>();
+            }
+
+            if (buffer_watermarks.prebuffer_ms < 0 || buffer_watermarks.capacity_ms <= 0 ||
+                buffer_watermarks.max_bytes == 0 || buffer_watermarks.assumed_kbps <= 0) {
+                Log::ErrorF("Incorrect watermarks");
+                return false;
+            }
+
+            buffer_watermarks_ = buffer_watermarks;
+        } // else: watermarks is optional
+
+        if (config["adaptiveBuffer"]) {
+            const YAML::Node& adaptive_node = config["adaptiveBuffer"];
+            if (!adaptive_node.IsMap()) {
+                Log::ErrorF("adaptiveBuffer field must be a map");
+                return false;
+            }
+
+            if (adaptive_node["enabled"].as<bool>(true)) {
+                AdaptiveBufferConfig adaptive_buffer;
+                if (adaptive_node["profileFile"]) {
+                    adaptive_buffer.profile_file = adaptive_node["profileFile"].as<std::string>();
+                } else {
+                    // Next to the yaml file: BonDriver_EPGStation.yml -> BonDriver_EPGStation.profiles.yml
+                    size_t ext_pos = filename.rfind('.');
+                    adaptive_buffer.profile_file = filename.substr(0, ext_pos) + ".profiles.yml";
+                }
+                adaptive_buffer_ = adaptive_buffer;
+            }
+        } // else: adaptiveBuffer is optional
+
+        if (config["zeroCopyReceive"]) {
+            zero_copy_receive_ = config["zeroCopyReceive"].as<bool>();
+        } // else: zeroCopyReceive is optional
+
+        if (config["reactor"]) {
+            use_reactor_ = config["reactor"].as<bool>();
+        } // else: reactor is optional
+
+        if (config["http2"]) {
+            http2_ = config["http2"].as<bool>();
+        } // else: http2 is optional
+
+        if (config["preconnect"]) {
+            preconnect_ = config["preconnect"].as<bool>();
+        } // else: preconnect is optional
+
+        if (config["nativeHttp"]) {
+            native_http_ = config["nativeHttp"].as<bool>();
+        } // else: nativeHttp is optional
+
+        if (config["overflowPolicy"]) {
+            std::string overflow_policy_desc = config["overflowPolicy"].as<std::string>();
+            if (overflow_policy_desc == "block") {
+                overflow_policy_ = kOverflowPolicyBlock;
+            } else if (overflow_policy_desc == "dropOldest") {
+                overflow_policy_ = kOverflowPolicyDropOldest;
+            } else if (overflow_policy_desc == "spill") {
+                overflow_policy_ = kOverflowPolicySpillToDisk;
+            } else {
+                Log::ErrorF("Incorrect overflowPolicy: %s", overflow_policy_desc.c_str());
+                return false;
+            }
+        } // else: overflowPolicy is optional
+
+        if (config["spillMaxMB"]) {
+            int64_t spill_max_mb = config["spillMaxMB"].as<int64_t>();
+            if (spill_max_mb <= 0 || spill_max_mb > std::numeric_limits<int64_t>::max() / (1024 * 1024)) {
+                Log::ErrorF("Incorrect spillMaxMB");
+                return false;
+            }
+            spill_max_bytes_ = static_cast<uint64_t>(spill_max_mb) * 1024 * 1024;
+        } // else: spillMaxMB is optional
+
+        if (config["standby"]) {
+            const YAML::Node& standby_node = config["standby"];
+            if (!standby_node.IsMap()) {
+                Log::ErrorF("standby field must be a map");
+                return false;
+            }
+
+            if (standby_node["enabled"].as<bool>(true)) {
+                StandbyConfig standby;
+                standby.count = standby_node["count"].as<size_t>(standby.count);
+                standby.max_kbps = standby_node["maxKbps"].as<int>(standby.max_kbps);
+                standby.window_ms = standby_node["windowMs"].as<int>(standby.window_ms);
+
+                if (standby.max_kbps < 0 || standby.window_ms <= 0) {
+                    Log::ErrorF("Incorrect standby");
+                    return false;
+                }
+
+                standby_ = standby;
+            }
+        } // else: standby is optional
+
+        if (config["makeBeforeBreak"]) {
+            const YAML::Node& make_before_break_node = config["makeBeforeBreak"];
+            if (!make_before_break_node.IsMap()) {
+                Log::ErrorF("makeBeforeBreak field must be a map");
+                return false;
+            }
+
+            if (make_before_break_node["enabled"].as<bool>(true)) {
+                MakeBeforeBreakConfig make_before_break;
+                make_before_break.switch_timeout_ms = make_before_break_node["switchTimeoutMs"].as<int>(make_before_break.switch_timeout_ms);
+                make_before_break_ = make_before_break;
+            }
+        } // else: makeBeforeBreak is optional
+
+        if (config["backpressure"]) {
+            const YAML::Node& backpressure_node = config["backpressure"];
+            if (!backpressure_node.IsMap()) {
+                Log::ErrorF("backpressure field must be a map");
+                return false;
+            }
+
+            if (backpressure_node["enabled"].as<bool>(true)) {
+                BackpressureConfig backpressure;
+                backpressure.high_watermark_percent = std::clamp(
+                        backpressure_node["highWatermarkPercent"].as<int>(backpressure.high_watermark_percent), 1, 100);
+                backpressure.low_watermark_percent = std::clamp(
+                        backpressure_node["lowWatermarkPercent"].as<int>(backpressure.low_watermark_percent),
+                        0, backpressure.high_watermark_percent);
+                backpressure_ = backpressure;
+            }
+        } // else: backpressure is optional
+
+        if (config["reconnect"]) {
+            const YAML::Node& reconnect_node = config["reconnect"];
+            if (!reconnect_node.IsMap()) {
+                Log::ErrorF("reconnect field must be a map");
+                return false;
+            }
+
+            if (reconnect_node["enabled"].as<bool>(true)) {
+                ReconnectPolicy reconnect_policy;
+                reconnect_policy.max_retries = reconnect_node["maxRetries"].as<int>(reconnect_policy.max_retries);
+                reconnect_policy.initial_delay_ms = reconnect_node["initialDelayMs"].as<int>(reconnect_policy.initial_delay_ms);
+                reconnect_policy.max_delay_ms = reconnect_node["maxDelayMs"].as<int>(reconnect_policy.max_delay_ms);
+                reconnect_policy.stall_timeout_s = reconnect_node["stallTimeoutSec"].as<int>(reconnect_policy.stall_timeout_s);
+
+                if (reconnect_policy.max_retries < 0 || reconnect_policy.initial_delay_ms <= 0 ||
+                    reconnect_policy.max_delay_ms < reconnect_policy.initial_delay_ms ||
+                    reconnect_policy.stall_timeout_s < 0) {
+                    Log::ErrorF("Incorrect reconnect");
+                    return false;
+                }
+
+                reconnect_policy_ = reconnect_policy;
+            }
+        } // else: reconnect is optional
+
+        if (config["socket"]) {
+            const YAML::Node& socket_node = config["socket"];
+            if (!socket_node.IsMap()) {
+                Log::ErrorF("socket field must be a map");
+                return false;
+            }
+
+            // Both end up as int / long in bytes, which is 32-bit on Windows
+            int receive_buffer_kb = socket_node["receiveBufferKB"].as<int>(0);
+            long curl_buffer_kb = socket_node["curlBufferKB"].as<long>(0);
+            if (receive_buffer_kb < 0 || receive_buffer_kb > std::numeric_limits<int>::max() / 1024 ||
+                curl_buffer_kb < 0 || curl_buffer_kb > std::numeric_limits<long>::max() / 1024) {
+                Log::ErrorF("Incorrect receiveBufferKB or curlBufferKB");
+                return false;
+            }
+
+            SocketTuning socket_tuning;
+            socket_tuning.receive_buffer_bytes = receive_buffer_kb * 1024;
+            if (socket_node["tcpNoDelay"]) {
+                socket_tuning.tcp_no_delay = socket_node["tcpNoDelay"].as<bool>();
+            }
+            socket_tuning.keepalive_idle_s = socket_node["keepAliveSec"].as<int>(0);
+            socket_tuning.keepalive_interval_s = socket_node["keepAliveIntervalSec"].as<int>(0);
+            socket_tuning.curl_buffer_bytes = curl_buffer_kb * 1024;
+            socket_tuning.low_speed_limit = socket_node["lowSpeedLimit"].as<long>(0);
+            socket_tuning.low_speed_time_s = socket_node["lowSpeedTimeSec"].as<long>(0);
+
+            if (socket_tuning.keepalive_idle_s < 0 || socket_tuning.keepalive_interval_s < 0) {
+                Log::ErrorF("Incorrect keepAliveSec or keepAliveIntervalSec");
+                return false;
+            }
+            if (socket_tuning.low_speed_limit < 0 || socket_tuning.low_speed_time_s < 0) {
+                Log::ErrorF("Incorrect lowSpeedLimit or lowSpeedTimeSec");
+                return false;
+            }
+
+            socket_tuning_ = socket_tuning;
+        } // else: socket is optional
+
     } catch (YAML::BadFile& ex) {
         Log::ErrorF("Load yaml file failed, %s", ex.what());
         return false;
@@ -133,3 +419,75 @@ std::optional<std::string> Config::GetProxy() const {
 std::optional<std::map<std::string, std::string>> Config::GetHeaders() const {
     return headers_;
 }
+
+std::optional<StreamBufferType> Config::GetBufferType() const {
+    return buffer_type_;
+}
+
+std::optional<bool> Config::GetPacketAligned() const {
+    return packet_aligned_;
+}
+
+std::optional<WakeupPolicy> Config::GetWakeupPolicy() const {
+    return wakeup_policy_;
+}
+
+std::optional<bool> Config::GetZeroCopyReceive() const {
+    return zero_copy_receive_;
+}
+
+std::optional<OverflowPolicy> Config::GetOverflowPolicy() const {
+    return overflow_policy_;
+}
+
+std::optional<uint64_t> Config::GetSpillMaxBytes() const {
+    return spill_max_bytes_;
+}
+
+std::optional<BufferArenaConfig> Config::GetBufferArena() const {
+    return buffer_arena_;
+}
+
+std::optional<BufferWatermarks> Config::GetBufferWatermarks() const {
+    return buffer_watermarks_;
+}
+
+std::optional<AdaptiveBufferConfig> Config::GetAdaptiveBuffer() const {
+    return adaptive_buffer_;
+}
+
+std::optional<bool> Config::GetUseReactor() const {
+    return use_reactor_;
+}
+
+std::optional<StandbyConfig> Config::GetStandby() const {
+    return standby_;
+}
+
+std::optional<ReconnectPolicy> Config::GetReconnectPolicy() const {
+    return reconnect_policy_;
+}
+
+std::optional<SocketTuning> Config::GetSocketTuning() const {
+    return socket_tuning_;
+}
+
+std::optional<bool> Config::GetHttp2() const {
+    return http2_;
+}
+
+std::optional<bool> Config::GetPreconnect() const {
+    return preconnect_;
+}
+
+std::optional<MakeBeforeBreakConfig> Config::GetMakeBeforeBreak() const {
+    return make_before_break_;
+}
+
+std::optional<BackpressureConfig> Config::GetBackpressure() const {
+    return backpressure_;
+}
+
+std::optional<bool> Config::GetNativeHttp() const {
+    return native_http_;
+}
@@ -5,6 +5,8 @@
 #ifndef BONDRIVER_EPGSTATION_CONFIG_HPP
 #define BONDRIVER_EPGSTATION_CONFIG_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <map>
@@ -14,6 +16,108 @@ enum EPGStationVersion : int {
     kEPGStationVersionV2 = 2,
 };
 
+enum StreamBufferType : int {
+    kStreamBufferTypeBlocking = 0,
+    kStreamBufferTypeRing = 1,
+};
+
+// What the stream buffer does when the host doesn't read fast enough
+enum OverflowPolicy : int {
+    // Block the curl thread until the host has read something (default)
+    kOverflowPolicyBlock = 0,
+    // Drop the oldest chunk, the host sees a discontinuity
+    kOverflowPolicyDropOldest = 1,
+    // Queue overflow in a temp file and feed it back in order
+    kOverflowPolicySpillToDisk = 2,
+};
+
+// When the producer should wake a consumer parked on an empty buffer.
+// With every threshold left at 0 the consumer is woken on each write.
+struct WakeupPolicy {
+    size_t bytes = 0;
+    size_t packets = 0;
+    bool on_chunk_complete = false;
+    int max_delay_ms = 0;
+    // Iterations to spin (yielding) before parking on the condition variable
+    int spin_count = 0;
+};
+
+// Stream buffer watermarks in stream time, converted with the measured bitrate
+struct BufferWatermarks {
+    // Buffered before the host may read
+    int prebuffer_ms = 300;
+    // Buffered before the overflow policy kicks in
+    int capacity_ms = 1000;
+    // Absolute ceiling whatever the bitrate
+    size_t max_bytes = 16 * 1024 * 1024;
+    // Assumed until the bitrate has been measured
+    int assumed_kbps = 16000;
+};
+
+// Buffer geometry learned per channel, see ChannelProfiles
+struct AdaptiveBufferConfig {
+    std::string profile_file;
+};
+
+// Shared region backing the stream buffers, see BufferArena
+struct BufferArenaConfig {
+    // 0 disables the arena
+    size_t size_bytes = 0;
+    bool huge_pages = true;
+    bool lock = false;
+};
+
+// Socket and transfer knobs of the streaming connection, 0 keeps the system / curl default
+struct SocketTuning {
+    // SO_RCVBUF, set before connecting so that the window scale can follow
+    int receive_buffer_bytes = 0;
+    std::optional<bool> tcp_no_delay;
+    // TCP keepalive idle time, 0 leaves keepalive off
+    int keepalive_idle_s = 0;
+    int keepalive_interval_s = 0;
+    // CURLOPT_BUFFERSIZE, the size of curl's recv() calls. Write callbacks still carry at most
+    // CURL_MAX_WRITE_SIZE (16 KiB) each.
+    long curl_buffer_bytes = 0;
+    // Drop the stream when slower than low_speed_limit bytes/s for low_speed_time_s
+    long low_speed_limit = 0;
+    long low_speed_time_s = 0;
+};
+
+// Reconnect a dropped stream with bounded exponential backoff, see StreamLoader::SetReconnectPolicy()
+struct ReconnectPolicy {
+    // Consecutive failed attempts before giving up, 0 for unlimited
+    int max_retries = 0;
+    int initial_delay_ms = 500;
+    int max_delay_ms = 8000;
+    // A stream without any data for this long is considered dropped, 0 disables the check
+    int stall_timeout_s = 10;
+};
+
+// Streams kept open on the channels most likely to be tuned next
+struct StandbyConfig {
+    // Standby streams per tuner
+    size_t count = 1;
+    // Combined bitrate budget of the standby streams, 0 for unlimited
+    int max_kbps = 0;
+    // Trailing window kept by each standby stream
+    int window_ms = 500;
+};
+
+// Pause the transfer while the host is behind instead of blocking the network thread,
+// see StreamLoader::SetBackpressure()
+struct BackpressureConfig {
+    // Paused once the stream buffer is this full
+    int high_watermark_percent = 90;
+    // Resumed once the host has drained it down to this
+    int low_watermark_percent = 50;
+};
+
+// Keep feeding the previous channel until the new stream is ready, see BonDriver::SetChannel()
+struct MakeBeforeBreakConfig {
+    // Longest the previous channel keeps playing, switch anyway once elapsed
+    int switch_timeout_ms = 3000;
+};
+
 struct BasicAuth {
     std::string user;
     std::string password;
@@ -33,6 +137,24 @@ public:
     [[nodiscard]] std::optional<std::string> GetUserAgent() const;
     [[nodiscard]] std::optional<std::string> GetProxy() const;
     [[nodiscard]] std::optional<std::map<std::string, std::string>> GetHeaders() const;
+    [[nodiscard]] std::optional<StreamBufferType> GetBufferType() const;
+    [[nodiscard]] std::optional<bool> GetPacketAligned() const;
+    [[nodiscard]] std::optional<WakeupPolicy> GetWakeupPolicy() const;
+    [[nodiscard]] std::optional<BufferArenaConfig> GetBufferArena() const;
+    [[nodiscard]] std::optional<BufferWatermarks> GetBufferWatermarks() const;
+    [[nodiscard]] std::optional<AdaptiveBufferConfig> GetAdaptiveBuffer() const;
+    [[nodiscard]] std::optional<bool> GetZeroCopyReceive() const;
+    [[nodiscard]] std::optional<bool> GetUseReactor() const;
+    [[nodiscard]] std::optional<bool> GetHttp2() const;
+    [[nodiscard]] std::optional<bool> GetPreconnect() const;
+    [[nodiscard]] std::optional<bool> GetNativeHttp() const;
+    [[nodiscard]] std::optional<OverflowPolicy> GetOverflowPolicy() const;
+    [[nodiscard]] std::optional<uint64_t> GetSpillMaxBytes() const;
+    [[nodiscard]] std::optional<StandbyConfig> GetStandby() const;
+    [[nodiscard]] std::optional<MakeBeforeBreakConfig> GetMakeBeforeBreak() const;
+    [[nodiscard]] std::optional<BackpressureConfig> GetBackpressure() const;
+    [[nodiscard]] std::optional<ReconnectPolicy> GetReconnectPolicy() const;
+    [[nodiscard]] std::optional<SocketTuning> GetSocketTuning() const;
 private:
     bool is_loaded_;
     std::optional<std::string> base_url_;
@@ -43,6 +165,24 @@ private:
     std::optional<std::string> user_agent_;
     std::optional<std::string> proxy_;
     std::optional<std::map<std::string, std::string>> headers_;
+    std::optional<StreamBufferType> buffer_type_;
+    std::optional<bool> packet_aligned_;
+    std::optional<WakeupPolicy> wakeup_policy_;
+    std::optional<BufferArenaConfig> buffer_arena_;
+    std::optional<BufferWatermarks> buffer_watermarks_;
+    std::optional<AdaptiveBufferConfig> adaptive_buffer_;
+    std::optional<bool> zero_copy_receive_;
+    std::optional<bool> use_reactor_;
+    std::optional<bool> http2_;
+    std::optional<bool> preconnect_;
+    std::optional<bool> native_http_;
+    std::optional<OverflowPolicy> overflow_policy_;
+    std::optional<uint64_t> spill_max_bytes_;
+    std::optional<StandbyConfig> standby_;
+    std::optional<MakeBeforeBreakConfig> make_before_break_;
+    std::optional<BackpressureConfig> backpressure_;
+    std::optional<ReconnectPolicy> reconnect_policy_;
+    std::optional<SocketTuning> socket_tuning_;
 };
 
 #endif // BONDRIVER_EPGSTATION_CONFIG_HPP
@@ -0,0 +1,76 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include "log.hpp"
+#include "curl_share.hpp"
+
+CurlShare& CurlShare::Instance() {
+    // Intentionally leaked: easy handles attached to it may outlive static destruction
+    static CurlShare* instance = new CurlShare();
+    return *instance;
+}
+
+CurlShare::CurlShare() : share_(curl_share_init()) {
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &CurlShare::OnLock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &CurlShare::OnUnlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    // Not CURL_LOCK_DATA_CONNECT: the handles run on many threads at once, which a shared
+    // connection pool does not support. Reactor transfers reuse connections through its multi handle,
+    // API calls through the one easy handle EPGStationAPI keeps.
+}
+
+void CurlShare::SetHttpVersion(long http_version) {
+    http_version_ = http_version;
+}
+
+void CurlShare::Attach(CURL* easy) {
+    curl_easy_setopt(easy, CURLOPT_SHARE, share_);
+
+    long http_version = http_version_;
+    if (http_version != 0) {
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, http_version);
+        // Rather than opening a connection of its own while another one is still being set up
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    }
+}
+
+void CurlShare::RecordConnection(CURL* easy) {
+    long new_connections = 0;
+    if (curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &new_connections) != CURLE_OK) {
+        return;
+    }
+
+    if (new_connections == 0) {
+        connection_hits_++;
+    } else {
+        connection_misses_++;
+    }
+
+    long http_version = 0;
+    curl_easy_getinfo(easy, CURLINFO_HTTP_VERSION, &http_version);
+
+    Log::InfoF("CurlShare::RecordConnection(): Connection %s (%s), hits: %llu, misses: %llu",
+               new_connections == 0 ? "reused" : "opened",
+               http_version == CURL_HTTP_VERSION_2_0 ? "HTTP/2" : "HTTP/1.x",
+               static_cast<unsigned long long>(connection_hits_),
+               static_cast<unsigned long long>(connection_misses_));
+}
+
+CurlShareStats CurlShare::GetStats() {
+    CurlShareStats stats;
+    stats.connection_hits = connection_hits_;
+    stats.connection_misses = connection_misses_;
+    return stats;
+}
+
+void CurlShare::OnLock(CURL* /*easy*/, curl_lock_data data, curl_lock_access /*access*/, CurlShare* self) {
+    // Shared and single access are not told apart, the sections are short
+    self->mutexes_[data].lock();
+}
+
+void CurlShare::OnUnlock(CURL* /*easy*/, curl_lock_data data, CurlShare* self) {
+    self->mutexes_[data].unlock();
+}
@@ -0,0 +1,50 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_CURL_SHARE_HPP
+#define BONDRIVER_EPGSTATION_CURL_SHARE_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <curl/curl.h>
+#include "noncopyable.hpp"
+
+struct CurlShareStats {
+    // Transfers which went out on an already open connection: API calls after the first one, and reactor transfers
+    uint64_t connection_hits = 0;
+    // Transfers which had to open a new one
+    uint64_t connection_misses = 0;
+};
+
+// Process-wide CURLSH sharing the DNS cache and TLS sessions between all curl handles,
+// so that API calls and tunes skip name resolution and resume TLS sessions.
+class CurlShare {
+public:
+    static CurlShare& Instance();
+    // CURLOPT_HTTP_VERSION applied by Attach(), 0 leaves the curl default.
+    // With HTTP/2 the handles also wait for a connection they can multiplex on.
+    void SetHttpVersion(long http_version);
+    void Attach(CURL* easy);
+    // Count the transfer as a hit or a miss, once its response has arrived
+    void RecordConnection(CURL* easy);
+    CurlShareStats GetStats();
+private:
+    CurlShare();
+    // Never destroyed, see Instance()
+    ~CurlShare() = default;
+    static void OnLock(CURL* easy, curl_lock_data data, curl_lock_access access, CurlShare* self);
+    static void OnUnlock(CURL* easy, curl_lock_data data, CurlShare* self);
+private:
+    CURLSH* share_ = nullptr;
+    std::mutex mutexes_[CURL_LOCK_DATA_LAST];
+    std::atomic<long> http_version_ = 0;
+    std::atomic<uint64_t> connection_hits_ = 0;
+    std::atomic<uint64_t> connection_misses_ = 0;
+private:
+    DISALLOW_COPY_AND_ASSIGN(CurlShare);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_CURL_SHARE_HPP
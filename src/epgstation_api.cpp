@@ -4,8 +4,10 @@
 
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
+#include "curl_share.hpp"
 #include "epgstation_models_deserialize.hpp"
 #include "log.hpp"
+#include "stream_reactor.hpp"
 #include "string_utils.hpp"
 #include "epgstation_api.hpp"
 
@@ -17,6 +19,10 @@ static const char* kEPGStationAPIv1_Broadcasting = "/api/schedule/broadcasting";
 static const char* kEPGStationAPIv2_Broadcasting = "/api/schedules/broadcasting?isHalfWidth=false";
 static const char* kEPGStationAPI_StreamsLive = "/api/streams/live/";
 
+// A preconnect that takes longer is of no use to the first tune anyway
+static constexpr long kPreconnectConnectTimeoutMs = 3000;
+static constexpr long kPreconnectTimeoutMs = 5000;
+
 EPGStationAPI::EPGStationAPI(const std::string& base_url, EPGStationVersion version)
     : base_url_(base_url), version_(version) {}
 
@@ -42,97 +48,132 @@ void EPGStationAPI::SetHeaders(const std::map<std::string, std::string>& headers
 }
 
 std::optional<EPGStation::Config> EPGStationAPI::GetConfig() {
-    cpr::Session session;
-    session.SetUrl(cpr::Url{this->base_url_ + kEPGStationAPI_Config});
-
-    if (has_basic_auth_) {
-        session.SetAuth(cpr::Authentication{basicauth_user_, basicauth_password_});
-    }
-
-    if (has_user_agent_) {
-        session.SetUserAgent({user_agent_});
-    }
-
-    if (has_proxy_) {
-        session.SetProxies({{"http", proxy_},
-                            {"https", proxy_}});
+    std::optional<std::string> body = Get(kEPGStationAPI_Config);
+    if (!body.has_value()) {
+        return std::nullopt;
     }
 
-    if (has_headers_) {
-        for (auto& pair : headers_) {
-            cpr::Header header{{pair.first, pair.second}};
-            session.UpdateHeader(header);
-        }
-    }
+    json j = json::parse(body.value());
+    EPGStation::Config config = j.get<EPGStation::Config>();
 
-    cpr::Response response = session.Get();
+    return config;
+}
 
-    if (response.error) {
-        Log::ErrorF("curl failed for %s: error_code = %d, msg = %s", kEPGStationAPI_Config, response.error.code, response.error.message.c_str());
-        return std::nullopt;
-    } else if (response.status_code >= 400) {
-        Log::ErrorF("%s error: status_code = %d, body = %s", kEPGStationAPI_Config, response.status_code, response.text.c_str());
+std::optional<EPGStation::Channels> EPGStationAPI::GetChannels() {
+    std::optional<std::string> body = Get(kEPGStationAPI_Channels);
+    if (!body.has_value()) {
         return std::nullopt;
     }
 
-    json j = json::parse(response.text);
-    EPGStation::Config config = j.get<EPGStation::Config>();
+    json j = json::parse(body.value());
+    EPGStation::Channels channels = j.get<EPGStation::Channels>();
 
-    return config;
+    return channels;
 }
 
-std::optional<EPGStation::Channels> EPGStationAPI::GetChannels() {
-    cpr::Session session;
-    session.SetUrl(cpr::Url{this->base_url_ + kEPGStationAPI_Channels});
+std::optional<EPGStation::Broadcasting> EPGStationAPI::GetBroadcasting() {
+    const char* path_query = "";
 
-    if (has_basic_auth_) {
-        session.SetAuth(cpr::Authentication{basicauth_user_, basicauth_password_});
+    if (version_ == kEPGStationVersionV1) {
+        path_query = kEPGStationAPIv1_Broadcasting;
+    } else if (version_ == kEPGStationVersionV2) {
+        path_query = kEPGStationAPIv2_Broadcasting;
     }
 
-    if (has_user_agent_) {
-        session.SetUserAgent({user_agent_});
+    std::optional<std::string> body = Get(path_query);
+    if (!body.has_value()) {
+        return std::nullopt;
     }
 
-    if (has_proxy_) {
-        session.SetProxies({{"http", proxy_},
-                            {"https", proxy_}});
-    }
+    json j = json::parse(body.value());
+    EPGStation::Broadcasting broadcasting = j.get<EPGStation::Broadcasting>();
 
-    if (has_headers_) {
-        for (auto& pair : headers_) {
-            cpr::Header header{{pair.first, pair.second}};
-            session.UpdateHeader(header);
+    return broadcasting;
+}
+
+bool EPGStationAPI::Preconnect(bool through_reactor) {
+    std::string url = this->base_url_ + kEPGStationAPI_Config;
+    auto session = std::make_unique<cpr::Session>();
+    session->SetUrl(cpr::Url{url});
+    ApplyOptions(*session);
+
+    CURL* curl = session->GetCurlHolder()->handle;
+    // Dual-stack hosts race IPv6 against IPv4 (happy eyeballs), give the second family a head start of 200 ms
+    curl_easy_setopt(curl, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS, 200L);
+    session->SetTimeout(cpr::Timeout{std::chrono::milliseconds(kPreconnectTimeoutMs)});
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, kPreconnectConnectTimeoutMs);
+
+    if (through_reactor) {
+        // Connections of a multi handle are pooled there, not on the easy handle.
+        // cpr only applies these in Session::Head(), which is bypassed here.
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        if (has_proxy_) {
+            curl_easy_setopt(curl, CURLOPT_PROXY, proxy_.c_str());
+        }
+
+        std::promise<CURLcode> done;
+        std::future<CURLcode> result = done.get_future();
+        StreamReactor::Instance().Add(curl, [&done](CURLcode code, const StreamReactor::TransferStats&) {
+            done.set_value(code);
+        });
+        // Bounded by the timeouts above
+        CURLcode code = result.get();
+        if (code != CURLE_OK) {
+            Log::ErrorF("curl failed for preconnecting: error_code = %d, msg = %s", code, curl_easy_strerror(code));
+            return false;
+        }
+    } else {
+        cpr::Response response = session->Head();
+        if (response.error) {
+            Log::ErrorF("curl failed for preconnecting: error_code = %d, msg = %s", response.error.code, response.error.message.c_str());
+            return false;
         }
     }
+    CurlShare::Instance().RecordConnection(curl);
 
-    cpr::Response response = session.Get();
+    double dns_time = 0;
+    double connect_time = 0;
+    double tls_time = 0;
+    double total_time = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns_time);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect_time);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls_time);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time);
+    Log::InfoF("EPGStationAPI::Preconnect(): dns: %.1lf ms, connect: %.1lf ms, tls: %.1lf ms, total: %.1lf ms",
+               dns_time * 1000, connect_time * 1000, tls_time * 1000, total_time * 1000);
 
-    if (response.error) {
-        Log::ErrorF("curl failed for %s: error_code = %d, msg = %s", kEPGStationAPI_Channels, response.error.code, response.error.message.c_str());
-        return std::nullopt;
-    } else if (response.status_code >= 400) {
-        Log::ErrorF("%s error: status_code = %d, body = %s", kEPGStationAPI_Channels, response.status_code, response.text.c_str());
-        return std::nullopt;
-    }
+    if (!through_reactor) {
+        // The stream must not inherit the limits of the HEAD request
+        session->SetTimeout(cpr::Timeout{std::chrono::milliseconds(0)});
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 0L);
 
-    json j = json::parse(response.text);
-    EPGStation::Channels channels = j.get<EPGStation::Channels>();
+        std::lock_guard lock(preconnect_mutex_);
+        preconnected_session_ = std::move(session);
+    }
+    return true;
+}
 
-    return channels;
+std::unique_ptr<cpr::Session> EPGStationAPI::TakePreconnectedSession() {
+    std::lock_guard lock(preconnect_mutex_);
+    return std::move(preconnected_session_);
 }
 
-std::optional<EPGStation::Broadcasting> EPGStationAPI::GetBroadcasting() {
-    const char* path_query = "";
+std::string EPGStationAPI::GetMpegtsLiveStreamPathQuery(int64_t id, int encode_mode) {
+    std::string path_query = kEPGStationAPI_StreamsLive;
+    path_query.append(std::to_string(id));
 
     if (version_ == kEPGStationVersionV1) {
-        path_query = kEPGStationAPIv1_Broadcasting;
+        path_query.append("/mpegts?mode=");
     } else if (version_ == kEPGStationVersionV2) {
-        path_query = kEPGStationAPIv2_Broadcasting;
+        path_query.append("/m2ts?mode=");
     }
 
-    cpr::Session session;
-    session.SetUrl(cpr::Url{this->base_url_ + path_query});
+    path_query.append(std::to_string(encode_mode));
+    return path_query;
+}
 
+void EPGStationAPI::ApplyOptions(cpr::Session& session) {
     if (has_basic_auth_) {
         session.SetAuth(cpr::Authentication{basicauth_user_, basicauth_password_});
     }
@@ -153,7 +194,20 @@ std::optional<EPGStation::Broadcasting> EPGStationAPI::GetBroadcasting() {
         }
     }
 
-    cpr::Response response = session.Get();
+    CurlShare::Instance().Attach(session.GetCurlHolder()->handle);
+}
+
+std::optional<std::string> EPGStationAPI::Get(const char* path_query) {
+    std::lock_guard lock(session_mutex_);
+
+    if (!session_ready_) {
+        ApplyOptions(session_);
+        session_ready_ = true;
+    }
+    session_.SetUrl(cpr::Url{this->base_url_ + path_query});
+
+    cpr::Response response = session_.Get();
+    CurlShare::Instance().RecordConnection(session_.GetCurlHolder()->handle);
 
     if (response.error) {
         Log::ErrorF("curl failed for %s: error_code = %d, msg = %s", path_query, response.error.code, response.error.message.c_str());
@@ -163,22 +217,5 @@ std::optional<EPGStation::Broadcasting> EPGStationAPI::GetBroadcasting() {
         return std::nullopt;
     }
 
-    json j = json::parse(response.text);
-    EPGStation::Broadcasting broadcasting = j.get<EPGStation::Broadcasting>();
-
-    return broadcasting;
-}
-
-std::string EPGStationAPI::GetMpegtsLiveStreamPathQuery(int64_t id, int encode_mode) {
-    std::string path_query = kEPGStationAPI_StreamsLive;
-    path_query.append(std::to_string(id));
-
-    if (version_ == kEPGStationVersionV1) {
-        path_query.append("/mpegts?mode=");
-    } else if (version_ == kEPGStationVersionV2) {
-        path_query.append("/m2ts?mode=");
-    }
-
-    path_query.append(std::to_string(encode_mode));
-    return path_query;
+    return std::move(response.text);
 }
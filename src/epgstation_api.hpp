@@ -6,6 +6,9 @@
 #define BONDRIVER_EPGSTATION_EPGSTATION_API_HPP
 
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <cpr/session.h>
 #include "config.hpp"
 #include "epgstation_models.hpp"
 
@@ -19,7 +22,17 @@ public:
     std::optional<EPGStation::Config> GetConfig();
     std::optional<EPGStation::Channels> GetChannels();
     std::optional<EPGStation::Broadcasting> GetBroadcasting();
+    // Open a connection to the server with a cheap HEAD request, for the first stream to go out on.
+    // Through the reactor it stays in the pool of its multi handle, else on the handle that
+    // TakePreconnectedSession() hands over. Either way the DNS entry and TLS session are cached.
+    bool Preconnect(bool through_reactor);
+    // The handle connected by the last Preconnect() without the reactor, if nobody has taken it yet
+    std::unique_ptr<cpr::Session> TakePreconnectedSession();
     std::string GetMpegtsLiveStreamPathQuery(int64_t id, int encode_mode);
+private:
+    void ApplyOptions(cpr::Session& session);
+    // GET on session_, so that a refresh goes out on the keep-alive connection of the previous call
+    std::optional<std::string> Get(const char* path_query);
 private:
     std::string base_url_;
     EPGStationVersion version_;
@@ -36,6 +49,14 @@ private:
 
     bool has_headers_ = false;
     std::map<std::string, std::string> headers_;
+
+    // One easy handle for all API calls, set up by the first one
+    std::mutex session_mutex_;
+    cpr::Session session_;
+    bool session_ready_ = false;
+
+    std::mutex preconnect_mutex_;
+    std::unique_ptr<cpr::Session> preconnected_session_;
 };
 
 
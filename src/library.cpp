@@ -10,7 +10,10 @@
 #include <yaml-cpp/yaml.h>
 #include "IBonDriver.h"
 #include "bon_driver.hpp"
+#include "buffer_arena.hpp"
+#include "channel_profiles.hpp"
 #include "config.hpp"
+#include "curl_share.hpp"
 #include "log.hpp"
 #include "library.hpp"
 
@@ -51,6 +54,21 @@ extern "C" EXPORT_API IBonDriver* CreateBonDriver() {
         }
     }
 
+    if (config.GetBufferArena().has_value()) {
+        // Shared by every tuner in this process, only the first call maps it
+        BufferArena::Instance().Init(config.GetBufferArena().value());
+    }
+
+    if (config.GetAdaptiveBuffer().has_value()) {
+        ChannelProfiles::Instance().Load(config.GetAdaptiveBuffer()->profile_file);
+    }
+
+    if (config.GetHttp2().value_or(false)) {
+        // Plain http has no ALPN, the server has to speak h2c right away
+        bool is_tls = config.GetBaseURL()->rfind("https://", 0) == 0;
+        CurlShare::Instance().SetHttpVersion(is_tls ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+    }
+
     return new BonDriver(config);
 }
 
@@ -0,0 +1,499 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
+#include "log.hpp"
+#include "native_http_client.hpp"
+
+// Winsock has been initialized by curl_global_init() long before any stream is opened
+
+static bool SetNonBlocking(SOCKET sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+static bool IsWouldBlock() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+    return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+#endif
+}
+
+static int LastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static bool EqualsIgnoreCase(const std::string& a, const char* b) {
+    size_t length = strlen(b);
+    if (a.size() != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string Trim(const std::string& input) {
+    size_t begin = input.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = input.find_last_not_of(" \t\r");
+    return input.substr(begin, end - begin + 1);
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+NativeHttpClient::~NativeHttpClient() {
+    CloseSocket();
+}
+
+bool NativeHttpClient::CanHandle(const std::string& url, const std::optional<std::string>& proxy) {
+    if (proxy.has_value() && !proxy->empty()) {
+        return false;
+    }
+    return ParseUrl(url).has_value();
+}
+
+void NativeHttpClient::SetStallTimeout(std::chrono::milliseconds stall_timeout) {
+    stall_timeout_ = stall_timeout;
+}
+
+void NativeHttpClient::Cancel() {
+    std::lock_guard guard(socket_mutex_);
+    cancelled_ = true;
+    if (socket_ != INVALID_SOCKET) {
+        // Wakes up the poll in progress, the socket is closed by the thread running Get()
+        shutdown(socket_, SD_BOTH);
+    }
+}
+
+bool NativeHttpClient::IsCancelled() const {
+    return cancelled_;
+}
+
+NativeHttpClient::Result NativeHttpClient::Get(const std::string& url,
+                                               const std::map<std::string, std::string>& headers,
+                                               Sink& sink) {
+    std::optional<Url> parsed_url = ParseUrl(url);
+    if (!parsed_url.has_value()) {
+        Log::ErrorF("NativeHttpClient::Get(): Unsupported url %s", url.c_str());
+        return Result::kFailed;
+    }
+
+    // Fresh state for every request, a reconnect starts over
+    body_mode_ = BodyMode::kUntilClose;
+    content_remaining_ = 0;
+    chunked_decoder_.Reset();
+
+    auto begin = std::chrono::steady_clock::now();
+    Timings timings;
+
+    Result result = Connect(parsed_url.value(), sink, timings);
+    if (result != Result::kCompleted) {
+        CloseSocket();
+        return result;
+    }
+
+    std::string request = "GET " + parsed_url->target + " HTTP/1.1\r\n";
+    request += "Host: " + parsed_url->authority + "\r\n";
+    request += "Accept: */*\r\n";
+    request += "Connection: close\r\n";
+    for (const auto& [name, value] : headers) {
+        request += name + ": " + value + "\r\n";
+    }
+    request += "\r\n";
+
+    result = SendRequest(request);
+
+    int status_code = 0;
+    std::vector<uint8_t> body_prefix;
+    if (result == Result::kCompleted) {
+        result = ReceiveHeaders(status_code, body_prefix);
+    }
+
+    if (result == Result::kCompleted) {
+        timings.headers_ms = MillisecondsSince(begin);
+        if (!sink.OnNativeResponse(status_code, timings)) {
+            result = Result::kCancelled;
+        } else {
+            result = ReceiveBody(body_prefix, sink);
+        }
+    }
+
+    CloseSocket();
+    return result;
+}
+
+std::optional<NativeHttpClient::Url> NativeHttpClient::ParseUrl(const std::string& url) {
+    static const char kScheme[] = "http://";
+    if (url.compare(0, sizeof(kScheme) - 1, kScheme) != 0) {
+        // https and anything else stays with curl
+        return std::nullopt;
+    }
+
+    std::string rest = url.substr(sizeof(kScheme) - 1);
+    size_t path_pos = rest.find_first_of("/?");
+    std::string authority = rest.substr(0, path_pos);
+    if (authority.empty() || authority.find('@') != std::string::npos) {
+        // Credentials in the URL are left to curl
+        return std::nullopt;
+    }
+
+    Url result;
+    result.authority = authority;
+    result.target = path_pos == std::string::npos ? "/" : rest.substr(path_pos);
+    if (result.target[0] == '?') {
+        result.target.insert(0, "/");
+    }
+
+    if (authority[0] == '[') {
+        // [IPv6]:port
+        size_t bracket_pos = authority.find(']');
+        if (bracket_pos == std::string::npos) {
+            return std::nullopt;
+        }
+        result.host = authority.substr(1, bracket_pos - 1);
+        if (bracket_pos + 1 < authority.size()) {
+            if (authority[bracket_pos + 1] != ':') {
+                return std::nullopt;
+            }
+            result.port = authority.substr(bracket_pos + 2);
+        }
+    } else {
+        size_t colon_pos = authority.find(':');
+        result.host = authority.substr(0, colon_pos);
+        if (colon_pos != std::string::npos) {
+            result.port = authority.substr(colon_pos + 1);
+        }
+    }
+
+    if (result.port.empty()) {
+        result.port = "80";
+    }
+    if (result.host.empty() || result.port.find_first_not_of("0123456789") != std::string::npos) {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+NativeHttpClient::Result NativeHttpClient::Connect(const Url& url, Sink& sink, Timings& timings) {
+    auto begin = std::chrono::steady_clock::now();
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo* addresses = nullptr;
+    int ret = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &addresses);
+    if (ret != 0 || addresses == nullptr) {
+        Log::ErrorF("NativeHttpClient::Connect(): Resolving %s failed, error: %d", url.host.c_str(), ret);
+        return Result::kFailed;
+    }
+    timings.dns_ms = MillisecondsSince(begin);
+
+    Result result = Result::kFailed;
+
+    for (addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+        if (IsCancelled()) {
+            result = Result::kCancelled;
+            break;
+        }
+
+        SOCKET sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (sock == INVALID_SOCKET) {
+            continue;
+        }
+
+        sink.OnNativeSocketOpened(sock);
+        int no_delay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+        if (!SetNonBlocking(sock)) {
+            closesocket(sock);
+            continue;
+        }
+
+        {
+            std::lock_guard guard(socket_mutex_);
+            socket_ = sock;
+        }
+
+        if (connect(sock, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0) {
+            if (!IsWouldBlock() || !WaitSocket(true, kConnectTimeoutMs)) {
+                CloseSocket();
+                continue;
+            }
+
+            int error = 0;
+#ifdef _WIN32
+            int length = sizeof(error);
+#else
+            socklen_t length = sizeof(error);
+#endif
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0 || error != 0) {
+                Log::ErrorF("NativeHttpClient::Connect(): connect() failed, error: %d", error);
+                CloseSocket();
+                continue;
+            }
+        }
+
+        result = IsCancelled() ? Result::kCancelled : Result::kCompleted;
+        break;
+    }
+
+    freeaddrinfo(addresses);
+    timings.connect_ms = MillisecondsSince(begin);
+
+    if (result == Result::kFailed) {
+        Log::ErrorF("NativeHttpClient::Connect(): Connecting to %s failed", url.authority.c_str());
+    }
+    return result;
+}
+
+NativeHttpClient::Result NativeHttpClient::SendRequest(const std::string& request) {
+    size_t sent_bytes = 0;
+
+    while (sent_bytes < request.size()) {
+        int ret = send(socket_, request.data() + sent_bytes, static_cast<int>(request.size() - sent_bytes), 0);
+        if (ret > 0) {
+            sent_bytes += ret;
+        } else if (ret < 0 && IsWouldBlock()) {
+            if (!WaitSocket(true, kConnectTimeoutMs)) {
+                return IsCancelled() ? Result::kCancelled : Result::kFailed;
+            }
+        } else {
+            Log::ErrorF("NativeHttpClient::SendRequest(): send() failed, error: %d", LastSocketError());
+            return IsCancelled() ? Result::kCancelled : Result::kFailed;
+        }
+    }
+
+    return Result::kCompleted;
+}
+
+NativeHttpClient::Result NativeHttpClient::ReceiveHeaders(int& status_code, std::vector<uint8_t>& body_prefix) {
+    std::string buffer;
+    char data[4096];
+    int timeout_ms = stall_timeout_.count() > 0 ? static_cast<int>(stall_timeout_.count()) : -1;
+
+    while (true) {
+        size_t header_end = buffer.find("\r\n\r\n");
+        if (header_end != std::string::npos) {
+            body_prefix.assign(buffer.begin() + header_end + 4, buffer.end());
+            if (!ParseHeaders(buffer.substr(0, header_end + 2), status_code)) {
+                return Result::kFailed;
+            }
+            return Result::kCompleted;
+        }
+        if (buffer.size() > kMaxHeaderBytes) {
+            Log::ErrorF("NativeHttpClient::ReceiveHeaders(): Headers larger than %zu bytes", kMaxHeaderBytes);
+            return Result::kFailed;
+        }
+
+        int ret = recv(socket_, data, sizeof(data), 0);
+        if (ret > 0) {
+            buffer.append(data, ret);
+        } else if (ret < 0 && IsWouldBlock()) {
+            if (!WaitSocket(false, timeout_ms)) {
+                return IsCancelled() ? Result::kCancelled : Result::kFailed;
+            }
+        } else {
+            if (!IsCancelled()) {
+                Log::ErrorF("NativeHttpClient::ReceiveHeaders(): Connection closed before the headers, error: %d",
+                            ret < 0 ? LastSocketError() : 0);
+            }
+            return IsCancelled() ? Result::kCancelled : Result::kFailed;
+        }
+    }
+}
+
+bool NativeHttpClient::ParseHeaders(const std::string& headers, int& status_code) {
+    // HTTP/1.1 200 OK
+    size_t line_end = headers.find("\r\n");
+    std::string status_line = headers.substr(0, line_end);
+    if (status_line.compare(0, 7, "HTTP/1.") != 0 || status_line.size() < 12) {
+        Log::ErrorF("NativeHttpClient::ParseHeaders(): Invalid status line: %s", status_line.c_str());
+        return false;
+    }
+    status_code = atoi(status_line.c_str() + 9);
+
+    size_t pos = line_end + 2;
+    while (pos < headers.size()) {
+        line_end = headers.find("\r\n", pos);
+        std::string line = headers.substr(pos, line_end - pos);
+        pos = line_end + 2;
+
+        size_t colon_pos = line.find(':');
+        if (colon_pos == std::string::npos) {
+            continue;
+        }
+        std::string name = Trim(line.substr(0, colon_pos));
+        std::string value = Trim(line.substr(colon_pos + 1));
+
+        if (EqualsIgnoreCase(name, "Transfer-Encoding")) {
+            if (!EqualsIgnoreCase(value, "chunked")) {
+                Log::ErrorF("NativeHttpClient::ParseHeaders(): Unsupported Transfer-Encoding: %s", value.c_str());
+                return false;
+            }
+            body_mode_ = BodyMode::kChunked;
+        } else if (EqualsIgnoreCase(name, "Content-Length") && body_mode_ != BodyMode::kChunked) {
+            body_mode_ = BodyMode::kContentLength;
+            content_remaining_ = strtoull(value.c_str(), nullptr, 10);
+        }
+    }
+
+    return true;
+}
+
+NativeHttpClient::Result NativeHttpClient::ReceiveBody(std::vector<uint8_t>& body_prefix, Sink& sink) {
+    int timeout_ms = stall_timeout_.count() > 0 ? static_cast<int>(stall_timeout_.count()) : -1;
+
+    // Whatever arrived along with the headers goes through the sink's regions too
+    size_t prefix_pos = 0;
+    while (prefix_pos < body_prefix.size() && !IsBodyComplete()) {
+        std::pair<uint8_t*, size_t> region = sink.GetNativeReceiveRegion();
+        if (region.second == 0 || IsCancelled()) {
+            return Result::kCancelled;
+        }
+        size_t bytes = std::min(region.second, body_prefix.size() - prefix_pos);
+        memcpy(region.first, body_prefix.data() + prefix_pos, bytes);
+        prefix_pos += bytes;
+
+        size_t payload_bytes = DecodeBody(region.first, bytes);
+        if (payload_bytes > 0 && !sink.OnNativeData(region.first, payload_bytes)) {
+            return Result::kCancelled;
+        }
+    }
+
+    while (!IsBodyComplete()) {
+        if (chunked_decoder_.IsError()) {
+            Log::ErrorF("NativeHttpClient::ReceiveBody(): Malformed chunked encoding");
+            return Result::kFailed;
+        }
+
+        std::pair<uint8_t*, size_t> region = sink.GetNativeReceiveRegion();
+        if (region.second == 0 || IsCancelled()) {
+            return Result::kCancelled;
+        }
+
+        int ret = recv(socket_, reinterpret_cast<char*>(region.first), static_cast<int>(std::min<size_t>(region.second, INT32_MAX)), 0);
+        if (ret > 0) {
+            size_t payload_bytes = DecodeBody(region.first, ret);
+            if (payload_bytes > 0 && !sink.OnNativeData(region.first, payload_bytes)) {
+                return Result::kCancelled;
+            }
+        } else if (ret < 0 && IsWouldBlock()) {
+            if (!WaitSocket(false, timeout_ms)) {
+                if (IsCancelled()) {
+                    return Result::kCancelled;
+                }
+                Log::ErrorF("NativeHttpClient::ReceiveBody(): No data for %d ms", timeout_ms);
+                return Result::kFailed;
+            }
+        } else if (ret == 0 && body_mode_ == BodyMode::kUntilClose) {
+            return Result::kCompleted;
+        } else {
+            if (IsCancelled()) {
+                return Result::kCancelled;
+            }
+            Log::ErrorF("NativeHttpClient::ReceiveBody(): Connection closed before the end of the body, error: %d",
+                        ret < 0 ? LastSocketError() : 0);
+            return Result::kFailed;
+        }
+    }
+
+    return Result::kCompleted;
+}
+
+size_t NativeHttpClient::DecodeBody(uint8_t* data, size_t bytes) {
+    switch (body_mode_) {
+        case BodyMode::kChunked:
+            return chunked_decoder_.Decode(data, bytes);
+        case BodyMode::kContentLength: {
+            // Anything past the announced length is ignored
+            size_t payload_bytes = static_cast<size_t>(std::min<uint64_t>(bytes, content_remaining_));
+            content_remaining_ -= payload_bytes;
+            return payload_bytes;
+        }
+        case BodyMode::kUntilClose:
+        default:
+            return bytes;
+    }
+}
+
+bool NativeHttpClient::IsBodyComplete() const {
+    switch (body_mode_) {
+        case BodyMode::kChunked:
+            return chunked_decoder_.IsDone();
+        case BodyMode::kContentLength:
+            return content_remaining_ == 0;
+        case BodyMode::kUntilClose:
+        default:
+            return false;
+    }
+}
+
+bool NativeHttpClient::WaitSocket(bool writable, int timeout_ms) {
+    if (IsCancelled()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    WSAPOLLFD poll_fd = {};
+    poll_fd.fd = socket_;
+    poll_fd.events = writable ? POLLWRNORM : POLLRDNORM;
+    int ret = WSAPoll(&poll_fd, 1, timeout_ms);
+#else
+    pollfd poll_fd = {};
+    poll_fd.fd = socket_;
+    poll_fd.events = writable ? POLLOUT : POLLIN;
+    int ret;
+    do {
+        ret = poll(&poll_fd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+#endif
+
+    // Errors and hang-ups are picked up by the next send() / recv()
+    return ret > 0 && !IsCancelled();
+}
+
+void NativeHttpClient::CloseSocket() {
+    std::lock_guard guard(socket_mutex_);
+    if (socket_ != INVALID_SOCKET) {
+        closesocket(socket_);
+        socket_ = INVALID_SOCKET;
+    }
+}
@@ -0,0 +1,114 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_NATIVE_HTTP_CLIENT_HPP
+#define BONDRIVER_EPGSTATION_NATIVE_HTTP_CLIENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+    #include <winsock2.h>
+#else
+    #include "min_win32_typedef.hpp"
+#endif
+#include "chunked_decoder.hpp"
+#include "noncopyable.hpp"
+
+// Bare HTTP/1.1 client for the one long GET of a live stream from a plain-HTTP server on the LAN.
+// Non-blocking socket, chunked transfer decoded in place, and recv() straight into whatever region
+// the sink hands out, ideally the free space of the stream buffer. One request per connection.
+// Anything beyond that (https, proxies) is left to curl, see CanHandle().
+class NativeHttpClient {
+public:
+    enum class Result {
+        kCompleted,
+        kCancelled,
+        kFailed
+    };
+    // Cumulative since Get() was entered
+    struct Timings {
+        double dns_ms = 0;
+        double connect_ms = 0;
+        double headers_ms = 0;
+    };
+    // Called on the thread running Get()
+    class Sink {
+    public:
+        virtual ~Sink() = default;
+        // Before connecting, e.g. to size the receive buffer
+        virtual void OnNativeSocketOpened(SOCKET sock) = 0;
+        // Status line and headers received, return false to cancel
+        virtual bool OnNativeResponse(int status_code, const Timings& timings) = 0;
+        // Where the next recv() goes, may block until there is room
+        virtual std::pair<uint8_t*, size_t> GetNativeReceiveRegion() = 0;
+        // Payload at the start of the region handed out last, transfer framing already removed.
+        // Return false to cancel.
+        virtual bool OnNativeData(uint8_t* data, size_t bytes) = 0;
+    };
+public:
+    NativeHttpClient() = default;
+    ~NativeHttpClient();
+    // Whether a GET of url can be served without curl
+    static bool CanHandle(const std::string& url, const std::optional<std::string>& proxy);
+    // Fail once no data has arrived for this long, 0 to wait forever. Must be called before Get().
+    void SetStallTimeout(std::chrono::milliseconds stall_timeout);
+    // Blocks until the response has ended, failed or been cancelled
+    Result Get(const std::string& url, const std::map<std::string, std::string>& headers, Sink& sink);
+    // Thread-safe, makes the running and every later Get() return kCancelled
+    void Cancel();
+private:
+    enum class BodyMode {
+        kUntilClose,
+        kContentLength,
+        kChunked
+    };
+    struct Url {
+        std::string host;
+        std::string port;
+        // Host header value
+        std::string authority;
+        std::string target;
+    };
+private:
+    static std::optional<Url> ParseUrl(const std::string& url);
+    Result Connect(const Url& url, Sink& sink, Timings& timings);
+    Result SendRequest(const std::string& request);
+    Result ReceiveHeaders(int& status_code, std::vector<uint8_t>& body_prefix);
+    Result ReceiveBody(std::vector<uint8_t>& body_prefix, Sink& sink);
+    bool ParseHeaders(const std::string& headers, int& status_code);
+    // Strips the framing of the bytes just received in place, returns the payload size
+    size_t DecodeBody(uint8_t* data, size_t bytes);
+    bool IsBodyComplete() const;
+    // false on timeout or error
+    bool WaitSocket(bool writable, int timeout_ms);
+    void CloseSocket();
+    bool IsCancelled() const;
+private:
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr int kConnectTimeoutMs = 10 * 1000;
+private:
+    std::chrono::milliseconds stall_timeout_ = std::chrono::milliseconds(0);
+
+    // Guards socket_ against Cancel()
+    std::mutex socket_mutex_;
+    SOCKET socket_ = INVALID_SOCKET;
+    std::atomic<bool> cancelled_ = false;
+
+    BodyMode body_mode_ = BodyMode::kUntilClose;
+    uint64_t content_remaining_ = 0;
+    ChunkedDecoder chunked_decoder_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(NativeHttpClient);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_NATIVE_HTTP_CLIENT_HPP
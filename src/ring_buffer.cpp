@@ -0,0 +1,370 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include "log.hpp"
+#include "ring_buffer.hpp"
+
+
+RingBuffer::RingBuffer(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count)
+    : chunk_size_(chunk_size), capacity_(chunk_size * max_chunk_count), limit_bytes_(capacity_),
+    min_readable_bytes_(std::min(chunk_size * min_chunk_count, chunk_size * max_chunk_count)),
+    data_(BufferArena::Instance().Allocate(chunk_size * max_chunk_count)) {
+    assert(capacity_ > 0);
+}
+
+RingBuffer::~RingBuffer() {
+    if (!is_exit_) {
+        NotifyExit();
+    }
+}
+
+size_t RingBuffer::Read(uint8_t* buffer, size_t expected_bytes) {
+    // I am the data consumer
+    assert(buffer != nullptr);
+    assert(expected_bytes > 0);
+    assert(!is_exit_);
+
+    ReleaseRetained();
+
+    if (ReadableBytes() < min_readable_bytes_) {
+        // consumer standby, waiting for prebuffering
+        WaitReadable(min_readable_bytes_);
+    }
+
+    uint8_t* out = buffer;
+    size_t bytes_read = 0;
+    size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+
+    while (bytes_read < expected_bytes) {
+        size_t readable = write_pos_.load(std::memory_order_acquire) - read_pos;
+
+        if (readable == 0) {
+            WaitReadable(1);
+            readable = write_pos_.load(std::memory_order_acquire) - read_pos;
+            if (readable == 0) {
+                // is_exit_
+                break;
+            }
+        }
+
+        if (resync_pending_) {
+            SkipToSync(read_pos, readable);
+            if (readable == 0) {
+                continue;
+            }
+        }
+
+        size_t index = read_pos % capacity_;
+        size_t bytes = std::min({expected_bytes - bytes_read, readable, capacity_ - index});
+        memcpy(out, data_.get() + index, bytes);
+
+        bytes_read += bytes;
+        out += bytes;
+        read_pos += bytes;
+        read_pos_.store(read_pos, std::memory_order_seq_cst);
+
+        NotifyProducer();
+    }
+
+    return bytes_read;
+}
+
+std::pair<uint8_t*, size_t> RingBuffer::ReadChunkAndRetain() {
+    // I am the data consumer
+    ReleaseRetained();
+
+    if (ReadableBytes() < min_readable_bytes_) {
+        // consumer standby, waiting for prebuffering
+        WaitReadable(min_readable_bytes_);
+    }
+
+    size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+    size_t readable = write_pos_.load(std::memory_order_acquire) - read_pos;
+
+    do {
+        if (readable == 0) {
+            WaitReadable(1);
+            readable = write_pos_.load(std::memory_order_acquire) - read_pos;
+            if (readable == 0) {
+                // is_exit_
+                return {nullptr, 0};
+            }
+        }
+
+        if (resync_pending_) {
+            SkipToSync(read_pos, readable);
+        }
+    } while (readable == 0);
+
+    size_t index = read_pos % capacity_;
+    size_t bytes = std::min({readable, capacity_ - index, chunk_size_});
+
+    // Keep read_pos_ untouched so that the producer cannot overwrite the region
+    // until the next Read() / ReadChunkAndRetain() releases it
+    retained_bytes_.store(bytes, std::memory_order_relaxed);
+
+    // Leased bytes no longer count as readable, WaitUntilEmpty() may be satisfied now
+    NotifyProducer();
+
+    return {data_.get() + index, bytes};
+}
+
+size_t RingBuffer::Write(const uint8_t* buffer, size_t bytes) {
+    // I am the data producer
+    assert(buffer != nullptr);
+    assert(bytes > 0);
+    assert(!is_exit_);
+
+    const uint8_t* in = buffer;
+    size_t bytes_written = 0;
+    size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+
+    while (bytes_written < bytes) {
+        size_t writable = WritableBytesAt(write_pos);
+
+        if (writable == 0) {
+            WaitWritable();
+            writable = WritableBytesAt(write_pos);
+            if (writable == 0) {
+                // is_exit_
+                break;
+            }
+        }
+
+        size_t index = write_pos % capacity_;
+        size_t attempt_bytes = std::min({bytes - bytes_written, writable, capacity_ - index});
+        memcpy(data_.get() + index, in, attempt_bytes);
+
+        bytes_written += attempt_bytes;
+        in += attempt_bytes;
+        write_pos += attempt_bytes;
+        write_pos_.store(write_pos, std::memory_order_seq_cst);
+    }
+
+    NotifyConsumer();
+    return bytes_written;
+}
+
+std::pair<uint8_t*, size_t> RingBuffer::GetWriteRegion() {
+    // I am the data producer
+    size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+    size_t writable = WritableBytesAt(write_pos);
+
+    if (writable == 0) {
+        WaitWritable();
+        writable = WritableBytesAt(write_pos);
+        if (writable == 0) {
+            // is_exit_
+            return {nullptr, 0};
+        }
+    }
+
+    // The consumer only ever moves the read cursor forward, the region stays free until committed
+    size_t index = write_pos % capacity_;
+    return {data_.get() + index, std::min(writable, capacity_ - index)};
+}
+
+void RingBuffer::CommitWrite(size_t bytes) {
+    // I am the data producer, the bytes are already in the region returned by GetWriteRegion()
+    if (bytes == 0) {
+        return;
+    }
+    write_pos_.store(write_pos_.load(std::memory_order_relaxed) + bytes, std::memory_order_seq_cst);
+    NotifyConsumer();
+}
+
+void RingBuffer::WaitUntilData() {
+    WaitReadable(std::max<size_t>(min_readable_bytes_, 1));
+}
+
+void RingBuffer::WaitUntilEmpty() {
+    std::unique_lock locker(mutex_);
+    producer_waiting_.store(true, std::memory_order_seq_cst);
+    produce_cv_.wait(locker, [this] {
+        return ReadableBytes() == 0 || is_exit_;
+    });
+    producer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+void RingBuffer::NotifyExit() {
+    std::lock_guard guard(mutex_);
+
+    is_exit_ = true;
+    consume_cv_.notify_all();
+    produce_cv_.notify_all();
+}
+
+bool RingBuffer::IsExit() {
+    return is_exit_;
+}
+
+size_t RingBuffer::ReadableBytes() {
+    size_t read_pos = read_pos_.load(std::memory_order_acquire);
+    size_t retained = retained_bytes_.load(std::memory_order_relaxed);
+    return write_pos_.load(std::memory_order_acquire) - read_pos - retained;
+}
+
+size_t RingBuffer::WritableBytes() {
+    return WritableBytesAt(write_pos_.load(std::memory_order_relaxed));
+}
+
+void RingBuffer::Clear() {
+    // Consumer side operation: drop everything that has been published so far
+    retained_bytes_.store(0, std::memory_order_relaxed);
+    read_pos_.store(write_pos_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+    NotifyProducer();
+}
+
+size_t RingBuffer::Purge() {
+    // Publishing a new read cursor is all it takes, the producer only ever reads it
+    retained_bytes_.store(0, std::memory_order_relaxed);
+    size_t write_pos = write_pos_.load(std::memory_order_acquire);
+    size_t purged_bytes = write_pos - read_pos_.load(std::memory_order_relaxed);
+    read_pos_.store(write_pos, std::memory_order_seq_cst);
+
+    purged_bytes_.fetch_add(purged_bytes, std::memory_order_relaxed);
+    // The producer may have been stopped in the middle of a packet
+    resync_pending_ = true;
+
+    NotifyProducer();
+    return purged_bytes;
+}
+
+void RingBuffer::SetWakeupPolicy(const WakeupPolicy& policy) {
+    if (policy.spin_count > 0) {
+        spin_count_ = policy.spin_count;
+    }
+}
+
+void RingBuffer::SetOverflowPolicy(OverflowPolicy policy, uint64_t /*spill_max_bytes*/) {
+    if (policy != kOverflowPolicyBlock) {
+        Log::ErrorF("RingBuffer::SetOverflowPolicy(): Only the block policy is supported, ignored");
+    }
+}
+
+void RingBuffer::SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) {
+    size_t limit = std::clamp<size_t>(capacity_bytes, 1, capacity_);
+    limit_bytes_.store(limit, std::memory_order_seq_cst);
+    min_readable_bytes_.store(std::min(prebuffer_bytes, limit), std::memory_order_seq_cst);
+
+    // Either side may be parked on the old limits
+    NotifyProducer();
+    NotifyConsumer();
+}
+
+size_t RingBuffer::PrebufferBytes() {
+    return min_readable_bytes_.load(std::memory_order_relaxed);
+}
+
+StreamBufferStats RingBuffer::GetStats() {
+    StreamBufferStats stats;
+    stats.wakeups_sent = wakeups_sent_;
+    stats.wakeups_avoided = wakeups_avoided_;
+    stats.spin_hits = spin_hits_;
+    stats.purged_bytes = purged_bytes_;
+    return stats;
+}
+
+void RingBuffer::ReleaseRetained() {
+    size_t retained = retained_bytes_.exchange(0, std::memory_order_relaxed);
+    if (retained > 0) {
+        read_pos_.fetch_add(retained, std::memory_order_seq_cst);
+        NotifyProducer();
+    }
+}
+
+size_t RingBuffer::WritableBytesAt(size_t write_pos) {
+    size_t used = write_pos - read_pos_.load(std::memory_order_acquire);
+    size_t limit = limit_bytes_.load(std::memory_order_relaxed);
+    return used < limit ? limit - used : 0;
+}
+
+void RingBuffer::SkipToSync(size_t& read_pos, size_t& readable) {
+    // One contiguous part at a time, until a sync byte turns up or the published bytes run out.
+    // Nothing may be handed out while the resync is pending, even past the end of the storage.
+    size_t skipped = 0;
+    while (resync_pending_ && readable > 0) {
+        size_t index = read_pos % capacity_;
+        size_t span = std::min(readable, capacity_ - index);
+        size_t offset = TsUtils::FindSyncOffset(data_.get() + index, span);
+
+        read_pos += offset;
+        readable -= offset;
+        skipped += offset;
+        if (offset < span) {
+            resync_pending_ = false;
+        }
+    }
+
+    if (skipped > 0) {
+        read_pos_.store(read_pos, std::memory_order_seq_cst);
+        purged_bytes_.fetch_add(skipped, std::memory_order_relaxed);
+        NotifyProducer();
+    }
+}
+
+void RingBuffer::WaitReadable(size_t bytes) {
+    if (ReadableBytes() >= bytes || is_exit_) {
+        return;
+    }
+
+    for (int i = 0; i < spin_count_; i++) {
+        if (ReadableBytes() >= bytes || is_exit_) {
+            spin_hits_++;
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock locker(mutex_);
+    // The flag is published before re-checking the cursor, and the producer publishes
+    // the cursor before checking the flag, so at least one side observes the other.
+    // The fence keeps the acquire loads of the re-check from moving above the store.
+    consumer_waiting_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    consume_cv_.wait(locker, [this, bytes] {
+        return ReadableBytes() >= bytes || is_exit_;
+    });
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+void RingBuffer::WaitWritable() {
+    auto is_writable = [this] {
+        size_t used = write_pos_.load(std::memory_order_relaxed) - read_pos_.load(std::memory_order_seq_cst);
+        return used < limit_bytes_.load(std::memory_order_seq_cst) || is_exit_;
+    };
+
+    for (int i = 0; i < spin_count_; i++) {
+        if (is_writable()) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock locker(mutex_);
+    producer_waiting_.store(true, std::memory_order_seq_cst);
+    produce_cv_.wait(locker, is_writable);
+    producer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+void RingBuffer::NotifyConsumer() {
+    if (consumer_waiting_.load(std::memory_order_seq_cst)) {
+        std::lock_guard guard(mutex_);
+        consume_cv_.notify_one();
+        wakeups_sent_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        wakeups_avoided_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RingBuffer::NotifyProducer() {
+    if (producer_waiting_.load(std::memory_order_seq_cst)) {
+        std::lock_guard guard(mutex_);
+        produce_cv_.notify_one();
+    }
+}
@@ -0,0 +1,93 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_RING_BUFFER_HPP
+#define BONDRIVER_EPGSTATION_RING_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "buffer_arena.hpp"
+#include "noncopyable.hpp"
+#include "stream_buffer.hpp"
+
+// Single-producer / single-consumer ring buffer over one preallocated region.
+// Cursors are atomic and only grow, so the steady-state path is lock-free;
+// the mutex is only touched when one side has to park.
+class RingBuffer : public StreamBuffer {
+public:
+    RingBuffer(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count);
+    ~RingBuffer() override;
+    size_t Read(uint8_t* buffer, size_t expected_bytes) override;
+    std::pair<uint8_t*, size_t> ReadChunkAndRetain() override;
+    size_t Write(const uint8_t* buffer, size_t bytes) override;
+    std::pair<uint8_t*, size_t> GetWriteRegion() override;
+    void CommitWrite(size_t bytes) override;
+    void WaitUntilData() override;
+    void WaitUntilEmpty() override;
+    void NotifyExit() override;
+    bool IsExit() override;
+    size_t ReadableBytes() override;
+    size_t WritableBytes() override;
+    void Clear() override;
+    // Consumer side operation like Clear(), also ends the current lease
+    size_t Purge() override;
+    // Only spin_count applies, the ring wakes a parked consumer on every publish
+    void SetWakeupPolicy(const WakeupPolicy& policy) override;
+    // Only kOverflowPolicyBlock is supported, the producer never touches the read cursor
+    void SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes) override;
+    // The capacity given to the constructor is the ceiling, the storage is never reallocated
+    void SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) override;
+    size_t PrebufferBytes() override;
+    StreamBufferStats GetStats() override;
+private:
+    void ReleaseRetained();
+    size_t WritableBytesAt(size_t write_pos);
+    void SkipToSync(size_t& read_pos, size_t& readable);
+    void WaitReadable(size_t bytes);
+    void WaitWritable();
+    void NotifyConsumer();
+    void NotifyProducer();
+private:
+    static constexpr int kDefaultSpinCount = 64;
+private:
+    size_t chunk_size_;
+    size_t capacity_;
+    // Soft limit within capacity_, see SetCapacity()
+    std::atomic<size_t> limit_bytes_;
+    std::atomic<size_t> min_readable_bytes_;
+    BufferArena::Ptr data_;
+
+    // Both cursors are absolute byte offsets, index = pos % capacity_
+    alignas(64) std::atomic<size_t> write_pos_ = 0;
+    alignas(64) std::atomic<size_t> read_pos_ = 0;
+    // Bytes handed out by ReadChunkAndRetain(), released on the next read
+    std::atomic<size_t> retained_bytes_ = 0;
+
+    int spin_count_ = kDefaultSpinCount;
+
+    std::atomic<bool> is_exit_ = false;
+    std::atomic<bool> consumer_waiting_ = false;
+    std::atomic<bool> producer_waiting_ = false;
+    std::mutex mutex_;
+    std::condition_variable consume_cv_;
+    std::condition_variable produce_cv_;
+
+    std::atomic<uint64_t> wakeups_sent_ = 0;
+    std::atomic<uint64_t> wakeups_avoided_ = 0;
+    std::atomic<uint64_t> spin_hits_ = 0;
+
+    // Set by Purge(), only touched by the consumer
+    bool resync_pending_ = false;
+    std::atomic<uint64_t> purged_bytes_ = 0;
+private:
+    DISALLOW_COPY_AND_ASSIGN(RingBuffer);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_RING_BUFFER_HPP
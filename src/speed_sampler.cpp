@@ -78,6 +78,10 @@ float SpeedSampler::AverageKBps() {
     return static_cast<float>((total_bytes_ / elapsed_seconds) / 1024.0f);
 }
 
+size_t SpeedSampler::TotalBytes() {
+    return total_bytes_;
+}
+
 time_t SpeedSampler::GetCurrentClock() {
     LARGE_INTEGER current;
     QueryPerformanceCounter(&current);
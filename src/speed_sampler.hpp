@@ -25,6 +25,7 @@ public:
     float CurrentKBps();
     float LastSecondKBps();
     float AverageKBps();
+    size_t TotalBytes();
 private:
     time_t GetCurrentClock();
 private:
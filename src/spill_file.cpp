@@ -0,0 +1,146 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifdef _WIN32
+    #include <Windows.h>
+#endif
+#include <algorithm>
+#include "log.hpp"
+#include "spill_file.hpp"
+
+SpillFile::SpillFile(uint64_t capacity_bytes)
+    : capacity_(std::max<uint64_t>(capacity_bytes, 1)), pending_capacity_(capacity_) {}
+
+SpillFile::~SpillFile() {
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool SpillFile::Write(const uint8_t* data, size_t bytes) {
+    if (Size() + bytes > capacity_) {
+        return false;
+    }
+
+    if (!file_ && !Open()) {
+        return false;
+    }
+
+    uint64_t write_offset = write_offset_;
+    size_t bytes_written = 0;
+
+    while (bytes_written < bytes) {
+        // Split at the end of the file and wrap around to its beginning
+        uint64_t position = write_offset % capacity_;
+        size_t attempt_bytes = static_cast<size_t>(std::min<uint64_t>(bytes - bytes_written, capacity_ - position));
+
+        if (!Seek(position) || fwrite(data + bytes_written, 1, attempt_bytes, file_) != attempt_bytes) {
+            // Leave write_offset_ untouched, whatever made it to disk will be overwritten
+            return false;
+        }
+
+        bytes_written += attempt_bytes;
+        write_offset += attempt_bytes;
+    }
+
+    write_offset_ = write_offset;
+    return true;
+}
+
+size_t SpillFile::Read(uint8_t* buffer, size_t bytes) {
+    if (!file_ || Size() == 0) {
+        return 0;
+    }
+
+    if (bytes > Size()) {
+        bytes = static_cast<size_t>(Size());
+    }
+
+    size_t bytes_read = 0;
+
+    while (bytes_read < bytes) {
+        uint64_t position = read_offset_ % capacity_;
+        size_t attempt_bytes = static_cast<size_t>(std::min<uint64_t>(bytes - bytes_read, capacity_ - position));
+
+        if (!Seek(position)) {
+            break;
+        }
+
+        size_t chunk_read = fread(buffer + bytes_read, 1, attempt_bytes, file_);
+        bytes_read += chunk_read;
+        read_offset_ += chunk_read;
+
+        if (chunk_read < attempt_bytes) {
+            break;
+        }
+    }
+
+    ResetIfEmpty();
+    return bytes_read;
+}
+
+uint64_t SpillFile::Size() const {
+    return write_offset_ - read_offset_;
+}
+
+uint64_t SpillFile::Capacity() const {
+    return capacity_;
+}
+
+void SpillFile::SetCapacity(uint64_t capacity_bytes) {
+    pending_capacity_ = std::max<uint64_t>(capacity_bytes, 1);
+    ResetIfEmpty();
+}
+
+void SpillFile::Clear() {
+    read_offset_ = 0;
+    write_offset_ = 0;
+    ResetIfEmpty();
+}
+
+void SpillFile::ResetIfEmpty() {
+    if (read_offset_ != write_offset_) {
+        return;
+    }
+
+    // Fully drained, start over from the beginning of the file
+    read_offset_ = 0;
+    write_offset_ = 0;
+    capacity_ = pending_capacity_;
+}
+
+bool SpillFile::Open() {
+#ifdef _WIN32
+    // tmpfile() creates files in the root directory on MSVC, which usually requires elevation
+    char temp_dir[MAX_PATH + 1] = {0};
+    char temp_path[MAX_PATH + 1] = {0};
+
+    if (GetTempPathA(MAX_PATH, temp_dir) == 0 || GetTempFileNameA(temp_dir, "bon", 0, temp_path) == 0) {
+        Log::ErrorF("SpillFile::Open(): Get temp file name failed, error = %#010x", GetLastError());
+        return false;
+    }
+
+    // "D": delete the file when it is closed
+    file_ = fopen(temp_path, "w+bD");
+#else
+    file_ = tmpfile();
+#endif
+
+    if (!file_) {
+        Log::ErrorF("SpillFile::Open(): Create temp file failed");
+        return false;
+    }
+
+    Log::InfoF("SpillFile::Open(): Spilling stream data to temp file");
+    return true;
+}
+
+bool SpillFile::Seek(uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file_, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file_, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
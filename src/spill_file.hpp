@@ -0,0 +1,46 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_SPILL_FILE_HPP
+#define BONDRIVER_EPGSTATION_SPILL_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "noncopyable.hpp"
+
+// FIFO byte queue backed by an anonymous temporary file, which is removed on close.
+// Used circularly, so the file never grows beyond the capacity however long the
+// consumer keeps lagging behind. Not thread-safe, the owner serializes access.
+class SpillFile {
+public:
+    explicit SpillFile(uint64_t capacity_bytes);
+    ~SpillFile();
+    // Append to the tail, returns false if the file cannot be created or written.
+    // The caller keeps Size() + bytes within Capacity().
+    bool Write(const uint8_t* data, size_t bytes);
+    // Consume from the head
+    size_t Read(uint8_t* buffer, size_t bytes);
+    uint64_t Size() const;
+    uint64_t Capacity() const;
+    // Takes effect once the file is empty, the stored bytes are laid out for the current capacity
+    void SetCapacity(uint64_t capacity_bytes);
+    void Clear();
+private:
+    bool Open();
+    bool Seek(uint64_t offset);
+    void ResetIfEmpty();
+private:
+    std::FILE* file_ = nullptr;
+    // Logical positions, the file offset is position % capacity_
+    uint64_t read_offset_ = 0;
+    uint64_t write_offset_ = 0;
+    uint64_t capacity_;
+    uint64_t pending_capacity_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(SpillFile);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_SPILL_FILE_HPP
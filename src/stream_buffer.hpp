@@ -0,0 +1,67 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_STREAM_BUFFER_HPP
+#define BONDRIVER_EPGSTATION_STREAM_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "config.hpp"
+#include "ts_utils.hpp"
+
+struct StreamBufferStats {
+    uint64_t wakeups_sent = 0;
+    uint64_t wakeups_avoided = 0;
+    uint64_t spin_hits = 0;
+    // Overflow handling
+    uint64_t discontinuities = 0;
+    uint64_t dropped_bytes = 0;
+    uint64_t spilled_bytes = 0;
+    // Dropped by Purge(), including the bytes skipped to get back in sync
+    uint64_t purged_bytes = 0;
+};
+
+// Common interface of the buffers sitting between the curl thread (single producer)
+// and the BonDriver host (single consumer)
+class StreamBuffer {
+public:
+    virtual ~StreamBuffer() = default;
+    virtual size_t Read(uint8_t* buffer, size_t expected_bytes) = 0;
+    // Zero-copy read. The returned region is leased to the caller: it stays valid and is never
+    // touched by the producer until the next Read() / ReadChunkAndRetain() call releases it.
+    virtual std::pair<uint8_t*, size_t> ReadChunkAndRetain() = 0;
+    virtual size_t Write(const uint8_t* buffer, size_t bytes) = 0;
+    // Zero-copy write: the contiguous free region the next bytes go to, waiting for room like Write().
+    // Empty if the buffer cannot expose its free space, or on exit. Publish with CommitWrite().
+    virtual std::pair<uint8_t*, size_t> GetWriteRegion() = 0;
+    virtual void CommitWrite(size_t bytes) = 0;
+    virtual void WaitUntilData() = 0;
+    virtual void WaitUntilEmpty() = 0;
+    virtual void NotifyExit() = 0;
+    virtual bool IsExit() = 0;
+    // Occupancy queries are O(1) and lock-free, hosts poll them at high frequency
+    virtual size_t ReadableBytes() = 0;
+    // How much Write() accepts right now without blocking, SIZE_MAX if it never blocks
+    virtual size_t WritableBytes() = 0;
+    virtual void Clear() = 0;
+    // Drop everything buffered in constant time, delivery restarts on the next TS sync byte.
+    // Safe against the producer. Returns the number of bytes dropped.
+    virtual size_t Purge() = 0;
+    virtual void SetWakeupPolicy(const WakeupPolicy& policy) = 0;
+    virtual void SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes) = 0;
+    // Adjust the watermarks while streaming: how much is buffered before the consumer may
+    // read, and how much before the producer hits the overflow policy
+    virtual void SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) = 0;
+    // Reads wait until this much is buffered, 0 if they only wait for data
+    virtual size_t PrebufferBytes() = 0;
+    virtual StreamBufferStats GetStats() = 0;
+
+    size_t ReadablePackets() {
+        return ReadableBytes() / TsUtils::kPacketSize;
+    }
+};
+
+
+#endif // BONDRIVER_EPGSTATION_STREAM_BUFFER_HPP
@@ -3,9 +3,19 @@
 //
 
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <future>
 #include <functional>
+#ifndef _WIN32
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
 #include <cpr/cpr.h>
+#include "blocking_buffer.hpp"
+#include "curl_share.hpp"
+#include "ring_buffer.hpp"
 #include "log.hpp"
 #include "scope_guard.hpp"
 #include "string_utils.hpp"
@@ -13,26 +23,145 @@
 
 using namespace std::placeholders;
 
-StreamLoader::StreamLoader(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count) :
-        chunk_size_(chunk_size), blocking_buffer_(chunk_size, max_chunk_count, min_chunk_count) {
+static int GetSocketIntOption(SOCKET sock, int level, int name) {
+    int value = 0;
+#ifdef _WIN32
+    int length = sizeof(value);
+    if (getsockopt(sock, level, name, reinterpret_cast<char*>(&value), &length) != 0) {
+        return -1;
+    }
+#else
+    socklen_t length = sizeof(value);
+    if (getsockopt(sock, level, name, &value, &length) != 0) {
+        return -1;
+    }
+#endif
+    return value;
+}
+
+StreamLoader::StreamLoader(StreamBufferType buffer_type, size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count) :
+        chunk_size_(chunk_size) {
     assert(!has_requested_ && "Once requested StreamLoader cannot be reused!");
+
+    if (buffer_type == kStreamBufferTypeRing) {
+        stream_buffer_ = std::make_unique<RingBuffer>(chunk_size, max_chunk_count, min_chunk_count);
+    } else {
+        stream_buffer_ = std::make_unique<BlockingBuffer>(chunk_size, max_chunk_count, min_chunk_count);
+    }
 }
 
 StreamLoader::~StreamLoader() {
     if (IsPolling()) {
         Abort();
+    } else if (use_reactor_ && has_requested_) {
+        // The transfer may still be attached even though it has failed, e.g. on a 40x response
+        RemoveFromReactor();
     }
 }
 
+void StreamLoader::SetPacketAligned(bool packet_aligned) {
+    assert(!has_requested_);
+    // Chunk edges must fall on packet boundaries so that every chunk holds whole packets
+    assert(!packet_aligned || chunk_size_ % TsUtils::kPacketSize == 0);
+    packet_aligned_ = packet_aligned;
+}
+
+void StreamLoader::SetWakeupPolicy(const WakeupPolicy& policy) {
+    stream_buffer_->SetWakeupPolicy(policy);
+}
+
+void StreamLoader::SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes) {
+    stream_buffer_->SetOverflowPolicy(policy, spill_max_bytes);
+}
+
+void StreamLoader::SetWatermarks(const BufferWatermarks& watermarks) {
+    std::lock_guard guard(watermarks_mutex_);
+    watermarks_ = watermarks;
+
+    // Already streaming (a promoted standby): start from what has been measured
+    double kbps = speed_sampler_.LastSecondKBps() * 1024.0 * 8 / 1000;
+    ApplyWatermarks(kbps > 0 ? kbps : watermarks.assumed_kbps);
+    has_watermarks_ = true;
+}
+
+void StreamLoader::SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes) {
+    std::lock_guard guard(watermarks_mutex_);
+    has_watermarks_ = false;
+    watermarks_.reset();
+    stream_buffer_->SetCapacity(prebuffer_bytes, capacity_bytes);
+}
+
+void StreamLoader::SetStartupCallback(StartupCallback on_startup) {
+    assert(!has_requested_);
+    on_startup_ = std::move(on_startup);
+}
+
+void StreamLoader::SetSocketTuning(const SocketTuning& tuning) {
+    assert(!has_requested_);
+    socket_tuning_ = tuning;
+}
+
+void StreamLoader::SetReconnectPolicy(const ReconnectPolicy& policy) {
+    assert(!has_requested_);
+    assert(chunk_size_ % TsUtils::kPacketSize == 0);
+    reconnect_policy_ = policy;
+    packet_aligned_ = true;
+}
+
+void StreamLoader::SetUseReactor(bool use_reactor) {
+    assert(!has_requested_);
+    use_reactor_ = use_reactor;
+}
+
+void StreamLoader::SetBackpressure(const BackpressureConfig& backpressure) {
+    assert(!has_requested_);
+    backpressure_ = backpressure;
+}
+
+void StreamLoader::SetNativeHttp(bool native_http) {
+    assert(!has_requested_);
+    native_http_ = native_http;
+}
+
+void StreamLoader::AdoptSession(std::unique_ptr<cpr::Session> session) {
+    assert(!has_requested_);
+    assert(!use_reactor_);
+    session_ = std::move(*session);
+}
+
+void StreamLoader::SetZeroCopyReceive(bool zero_copy_receive) {
+    assert(!has_requested_);
+    zero_copy_receive_ = zero_copy_receive;
+}
+
 bool StreamLoader::Open(const std::string& base_url,
                         const std::string& path_query,
                         std::optional<BasicAuth> basic_auth,
                         std::optional<std::string> user_agent,
                         std::optional<std::string> proxy,
                         std::optional<std::map<std::string, std::string>> headers) {
+    open_time_ = std::chrono::steady_clock::now();
     std::string url = base_url + path_query;
     Log::InfoF("StreamLoader::Open(): Opening %s", url.c_str());
 
+    if (native_http_) {
+        if (use_reactor_) {
+            Log::InfoF("StreamLoader::Open(): Driven by the reactor, native HTTP client not used");
+        } else if (!NativeHttpClient::CanHandle(url, proxy)) {
+            Log::InfoF("StreamLoader::Open(): Not a plain-HTTP direct connection, falling back to curl");
+        } else {
+            std::map<std::string, std::string> native_headers = headers.value_or(std::map<std::string, std::string>());
+            if (user_agent) {
+                native_headers["User-Agent"] = user_agent.value();
+            }
+            if (basic_auth) {
+                native_headers["Authorization"] = "Basic " + StringUtils::Base64Encode(basic_auth->user + ":" + basic_auth->password);
+            }
+            OpenNative(url, std::move(native_headers));
+            return true;
+        }
+    }
+
     session_.SetUrl(cpr::Url{url});
 
     if (basic_auth) {
@@ -60,39 +189,107 @@ bool StreamLoader::Open(const std::string& base_url,
 
     auto holder = session_.GetCurlHolder();
     CURL* curl = holder->handle;
+    // Reuse the DNS cache and TLS sessions of the API calls and previous tunes
+    CurlShare::Instance().Attach(curl);
+    // A reused connection never goes through OnOpenSocketCallback(), so ForceShutdown() has no
+    // socket to kill. The progress callback runs at least once per second and can abort instead.
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &StreamLoader::OnProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
     curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, &StreamLoader::OnOpenSocketCallback);
     curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, this);
 
+    if (reconnect_policy_.has_value() && reconnect_policy_->stall_timeout_s > 0) {
+        // A silently dead connection would otherwise hang until the TCP keepalive gives up
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(reconnect_policy_->stall_timeout_s));
+    }
+
+    if (socket_tuning_.has_value()) {
+        // SO_RCVBUF is applied in OnOpenSocketCallback(), before connecting
+        const SocketTuning& tuning = socket_tuning_.value();
+        if (tuning.tcp_no_delay.has_value()) {
+            curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, tuning.tcp_no_delay.value() ? 1L : 0L);
+        }
+        if (tuning.keepalive_idle_s > 0) {
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, static_cast<long>(tuning.keepalive_idle_s));
+            if (tuning.keepalive_interval_s > 0) {
+                curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, static_cast<long>(tuning.keepalive_interval_s));
+            }
+        }
+        if (tuning.curl_buffer_bytes > 0) {
+            // curl clamps it to [1 KiB, CURL_MAX_READ_SIZE]
+            long buffer_size = std::clamp<long>(tuning.curl_buffer_bytes, 1024, CURL_MAX_READ_SIZE);
+            curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, buffer_size);
+        }
+        if (tuning.low_speed_limit > 0 && tuning.low_speed_time_s > 0) {
+            // Takes over from the stall check of the reconnect policy
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, tuning.low_speed_limit);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, tuning.low_speed_time_s);
+        }
+        Log::InfoF("StreamLoader::Open(): Socket tuning, rcvbuf: %d, nodelay: %d, keepalive: %d/%d s, "
+                   "curl buffer: %ld, low speed: %ld B/s for %ld s",
+                   tuning.receive_buffer_bytes,
+                   tuning.tcp_no_delay.has_value() ? static_cast<int>(tuning.tcp_no_delay.value()) : -1,
+                   tuning.keepalive_idle_s, tuning.keepalive_interval_s,
+                   tuning.curl_buffer_bytes, tuning.low_speed_limit, tuning.low_speed_time_s);
+    }
+
+    if (zero_copy_receive_ || use_reactor_) {
+        // Override the write function installed by SetWriteCallback() above. cpr leaves it alone
+        // as long as a WriteCallback is set, so curl hands its receive buffer directly to us.
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &StreamLoader::OnCurlWriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    }
+
     has_requested_ = true;
 
+    if (use_reactor_) {
+        // cpr only applies these in Session::Get(), which is bypassed here
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        if (proxy) {
+            curl_easy_setopt(curl, CURLOPT_PROXY, proxy->c_str());
+        }
+
+        StreamReactor::Instance().Add(curl, [this](CURLcode result, const StreamReactor::TransferStats& stats) {
+            OnTransferDone(result, stats);
+        });
+        return true;
+    }
+
     async_response_ = std::async(std::launch::async, [this] {
-        cpr::Response response = session_.Get();
-        bool has_error = false;
+        cpr::Response response;
 
-        if (socket_ == INVALID_SOCKET) {
-            Log::Info("StreamLoader::Open(): curl socket has been force closed by Abort()");
-        } else if (response.error && response.error.code != cpr::ErrorCode::REQUEST_CANCELLED) {
-            has_error = true;
-            Log::ErrorF("StreamLoader::Open(): curl failed with error_code: %d, msg = %s",
-                        response.error.code,
-                        response.error.message.c_str());
-        } else if (response.status_code >= 400) {
-            has_error = true;
-            Log::ErrorF("StreamLoader::Open(): Invalid status code: %d, body = %s",
-                        response.status_code,
-                        response.text.c_str());
-        }
+        while (true) {
+            response = session_.Get();
+            bool has_error = false;
 
-        if (has_error) {
-            std::lock_guard lock(response_mutex_);
-            has_response_received_ = true;
-            request_failed_ = true;
-            response_cv_.notify_all();
-        }
+            if (socket_ == INVALID_SOCKET) {
+                Log::Info("StreamLoader::Open(): curl socket has been force closed by Abort()");
+            } else if (response.error && response.error.code != cpr::ErrorCode::REQUEST_CANCELLED) {
+                has_error = true;
+                Log::ErrorF("StreamLoader::Open(): curl failed with error_code: %d, msg = %s",
+                            response.error.code,
+                            response.error.message.c_str());
+            } else if (response.status_code >= 400) {
+                has_error = true;
+                Log::ErrorF("StreamLoader::Open(): Invalid status code: %d, body = %s",
+                            response.status_code,
+                            response.text.c_str());
+            }
+
+            if (!has_error && !has_requested_abort_) {
+                Log::InfoF(LOG_FILE_MESSAGE("curl_easy_perform returned, pulling completed"));
+            }
 
-        if (!has_error && !has_requested_abort_) {
-            Log::InfoF(LOG_FILE_MESSAGE("curl_easy_perform returned, pulling completed"));
-            has_reached_eof_ = true;
+            if (reconnect_policy_.has_value() && has_streamed_ && PrepareReconnect()) {
+                continue;
+            }
+
+            OnTransferEnded(has_error);
+            break;
         }
 
         return response;
@@ -101,19 +298,140 @@ bool StreamLoader::Open(const std::string& base_url,
     return true;
 }
 
-StreamLoader::WaitResult StreamLoader::WaitForResponse(std::chrono::milliseconds timeout) {
-    std::unique_lock lock(response_mutex_);
+void StreamLoader::OpenNative(const std::string& url, std::map<std::string, std::string> headers) {
+    native_client_ = std::make_unique<NativeHttpClient>();
+
+    // Same stall checks as the curl path, the native client knows no speed, only silence
+    if (socket_tuning_.has_value() && socket_tuning_->low_speed_limit > 0 && socket_tuning_->low_speed_time_s > 0) {
+        native_client_->SetStallTimeout(std::chrono::seconds(socket_tuning_->low_speed_time_s));
+    } else if (reconnect_policy_.has_value() && reconnect_policy_->stall_timeout_s > 0) {
+        native_client_->SetStallTimeout(std::chrono::seconds(reconnect_policy_->stall_timeout_s));
+    }
+
+    // The packet aligner has to see the data before it reaches the buffer
+    native_direct_receive_ = !packet_aligned_;
+    native_receive_buffer_.resize(kNativeReceiveBufferSize);
+    Log::InfoF("StreamLoader::OpenNative(): Streaming with the native HTTP client, direct receive: %d",
+               static_cast<int>(native_direct_receive_));
+
+    has_requested_ = true;
+
+    async_response_ = std::async(std::launch::async, [this, url, headers = std::move(headers)] {
+        while (true) {
+            NativeHttpClient::Result result = native_client_->Get(url, headers, *this);
+            bool has_error = result == NativeHttpClient::Result::kFailed && !has_requested_abort_;
+
+            if (!has_error && !has_requested_abort_) {
+                Log::InfoF("StreamLoader::OpenNative(): Response ended, pulling completed");
+            }
+
+            if (reconnect_policy_.has_value() && has_streamed_ && PrepareReconnect()) {
+                continue;
+            }
+
+            OnTransferEnded(has_error);
+            break;
+        }
+
+        return cpr::Response();
+    });
+}
+
+void StreamLoader::OnNativeSocketOpened(SOCKET sock) {
+    ApplySocketOptions(sock);
+    if (socket_tuning_.has_value()) {
+        LogSocketOptions(sock);
+    }
+}
+
+bool StreamLoader::OnNativeResponse(int status_code, const NativeHttpClient::Timings& timings) {
+    if (has_requested_abort_) {
+        return false;
+    }
+
+    if (has_response_received_) {
+        if (!reconnecting_.exchange(false)) {
+            return true;
+        }
+        if (status_code < 200 || status_code >= 300) {
+            // Cancel, PrepareReconnect() decides whether to try again
+            Log::ErrorF("StreamLoader::OnNativeResponse(): Invalid status code on reconnect: %d", status_code);
+            return false;
+        }
+        Log::InfoF("StreamLoader::OnNativeResponse(): Reconnected, response code: %d", status_code);
+        return true;
+    }
+
+    ON_SCOPE_EXIT {
+        // Acquire mutex for WaitForResponse()
+        std::lock_guard lock(response_mutex_);
+        has_response_received_ = true;
+        // Notify WaitForResponse()
+        response_cv_.notify_all();
+    };
+
+    // The native client takes the first response as final, anything but a 2xx (an interim
+    // response, a redirect) would have its body streamed as TS
+    if (status_code < 200 || status_code >= 300) {
+        Log::ErrorF("StreamLoader::OnNativeResponse(): Invalid status code: %d", status_code);
+        request_failed_ = true;
+        return false;
+    }
+
+    has_streamed_ = true;
+    Log::InfoF("StreamLoader::OnNativeResponse(): Received response code: %d, dns: %.1lf ms, connect: %.1lf ms, "
+               "headers: %.1lf ms, start polling",
+               status_code, timings.dns_ms, timings.connect_ms, timings.headers_ms);
+
+    startup_timings_.stage_ms[kZapStageDns] = timings.dns_ms;
+    startup_timings_.stage_ms[kZapStageConnect] = timings.connect_ms;
+    // No TLS on this path
+    startup_timings_.stage_ms[kZapStageTls] = 0;
+    startup_timings_.stage_ms[kZapStageHeaders] = MillisecondsSinceOpen();
+    return true;
+}
+
+std::pair<uint8_t*, size_t> StreamLoader::GetNativeReceiveRegion() {
+    if (native_direct_receive_) {
+        std::pair<uint8_t*, size_t> region = stream_buffer_->GetWriteRegion();
+        if (region.second > 0) {
+            return region;
+        }
+        // Not supported by the buffer, or exiting
+    }
+    return {native_receive_buffer_.data(), native_receive_buffer_.size()};
+}
 
+bool StreamLoader::OnNativeData(uint8_t* data, size_t bytes) {
+    if (data == native_receive_buffer_.data()) {
+        return OnReceiveData(data, bytes);
+    }
+
+    // Received straight into the stream buffer, only left to publish
+    if (!AccountReceive(bytes)) {
+        return false;
+    }
+    stream_buffer_->CommitWrite(bytes);
+    if (!startup_reported_ && speed_sampler_.TotalBytes() >= TsUtils::kPacketSize) {
+        ReportStartup();
+    }
+    return true;
+}
+
+StreamLoader::WaitResult StreamLoader::WaitForResponse(std::chrono::milliseconds timeout) {
     if (!has_requested_) {
         return WaitResult::kWaitFailed;
     }
 
-    if (has_response_received_ && !request_failed_) {
-        return WaitResult::kResultOK;
+    // Lock-free fast path for polling hosts
+    if (has_response_received_) {
+        return request_failed_ ? WaitResult::kResultFailed : WaitResult::kResultOK;
     }
 
+    std::unique_lock lock(response_mutex_);
+
     bool pred = response_cv_.wait_for(lock, timeout, [this] {
-        return has_response_received_;
+        return has_response_received_.load();
     });
 
     if (!pred) {
@@ -138,7 +456,7 @@ StreamLoader::WaitResult StreamLoader::WaitForData() {
         return WaitResult::kResultFailed;
     }
 
-    blocking_buffer_.WaitUntilData();
+    stream_buffer_->WaitUntilData();
 
     if (request_failed_) {
         return WaitResult::kResultFailed;
@@ -147,12 +465,69 @@ StreamLoader::WaitResult StreamLoader::WaitForData() {
     return WaitResult::kResultOK;
 }
 
-curl_socket_t StreamLoader::OnOpenSocketCallback(StreamLoader* self, curlsocktype purpose, curl_sockaddr* addr) {
+curl_socket_t StreamLoader::OnOpenSocketCallback(StreamLoader* self, curlsocktype /*purpose*/, curl_sockaddr* addr) {
     SOCKET sock = socket(addr->family, addr->socktype, addr->protocol);
+    if (sock != INVALID_SOCKET) {
+        self->ApplySocketOptions(sock);
+    }
     self->socket_ = sock;
     return sock;
 }
 
+size_t StreamLoader::OnCurlWriteCallback(char* ptr, size_t size, size_t nmemb, StreamLoader* self) {
+    size_t bytes = size * nmemb;
+
+    if (self->use_reactor_ && !self->has_requested_abort_) {
+        // A full buffer must not block the reactor thread, which serves every other stream too.
+        // Publish the pause before re-checking, ResumeIfPaused() reads the flag after consuming.
+        self->paused_ = true;
+        if (self->ShouldPause(bytes)) {
+            // curl keeps the data and delivers it again once resumed, the socket
+            // receive buffer takes up what keeps arriving in the meantime
+            self->pause_count_++;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        self->paused_ = false;
+    }
+
+    if (!self->OnReceiveData(reinterpret_cast<const uint8_t*>(ptr), bytes)) {
+        // return a mismatched size to cancel the transfer, same as cpr does
+        return 0;
+    }
+
+    return bytes;
+}
+
+int StreamLoader::OnProgressCallback(StreamLoader* self, curl_off_t /*dltotal*/, curl_off_t /*dlnow*/,
+                                     curl_off_t /*ultotal*/, curl_off_t /*ulnow*/) {
+    // non-zero aborts the transfer
+    return self->has_requested_abort_ ? 1 : 0;
+}
+
+void StreamLoader::ApplySocketOptions(SOCKET sock) {
+    if (!socket_tuning_.has_value() || socket_tuning_->receive_buffer_bytes <= 0) {
+        return;
+    }
+
+    int receive_buffer_bytes = socket_tuning_->receive_buffer_bytes;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF,
+                   reinterpret_cast<const char*>(&receive_buffer_bytes), sizeof(receive_buffer_bytes)) != 0) {
+        Log::ErrorF("StreamLoader::ApplySocketOptions(): setsockopt(SO_RCVBUF, %d) failed", receive_buffer_bytes);
+    }
+}
+
+void StreamLoader::LogSocketOptions(SOCKET sock) {
+    // What the system actually granted, e.g. Linux doubles SO_RCVBUF and caps it at rmem_max
+    long curl_buffer_bytes = socket_tuning_.has_value() && socket_tuning_->curl_buffer_bytes > 0
+                             ? std::clamp<long>(socket_tuning_->curl_buffer_bytes, 1024, CURL_MAX_READ_SIZE)
+                             : CURL_MAX_WRITE_SIZE;
+    Log::InfoF("StreamLoader::LogSocketOptions(): Effective rcvbuf: %d, nodelay: %d, keepalive: %d, curl buffer: %ld",
+               GetSocketIntOption(sock, SOL_SOCKET, SO_RCVBUF),
+               GetSocketIntOption(sock, IPPROTO_TCP, TCP_NODELAY),
+               GetSocketIntOption(sock, SOL_SOCKET, SO_KEEPALIVE),
+               curl_buffer_bytes);
+}
+
 void StreamLoader::ForceShutdown() {
     if (socket_ != INVALID_SOCKET) {
         shutdown(socket_, SD_BOTH);
@@ -168,6 +543,9 @@ bool StreamLoader::OnHeaderCallback(std::string data) {
     }
 
     if (has_response_received_) {
+        if (reconnecting_.exchange(false)) {
+            return OnReconnectResponse();
+        }
         // status_code received, ignore subsequent callback
         return true;
     }
@@ -193,48 +571,433 @@ bool StreamLoader::OnHeaderCallback(std::string data) {
         return false;
     }
 
-    Log::InfoF("StreamLoader::OnHeaderCallback(): Received response code: %d, start polling", status_code);
+    has_streamed_ = true;
+    CurlShare::Instance().RecordConnection(curl);
+    if (socket_ == INVALID_SOCKET) {
+        // Reused connection
+        curl_socket_t active_socket = CURL_SOCKET_BAD;
+        if (curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &active_socket) == CURLE_OK) {
+            socket_ = active_socket;
+            // Too late for the window scale, the buffer can still grow up to it
+            ApplySocketOptions(socket_);
+        }
+    }
+    if (socket_tuning_.has_value() && socket_ != INVALID_SOCKET) {
+        LogSocketOptions(socket_);
+    }
+
+    // Cumulative since the request started, zero for the stages a warm connection skipped
+    double dns_time = 0;
+    double connect_time = 0;
+    double tls_time = 0;
+    double first_byte_time = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns_time);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect_time);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls_time);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &first_byte_time);
+    Log::InfoF("StreamLoader::OnHeaderCallback(): Received response code: %d, dns: %.1lf ms, connect: %.1lf ms, "
+               "tls: %.1lf ms, first byte: %.1lf ms, start polling",
+               status_code, dns_time * 1000, connect_time * 1000, tls_time * 1000, first_byte_time * 1000);
+
+    // curl measures from the start of the transfer, which is Open() give or take a thread hop
+    startup_timings_.stage_ms[kZapStageDns] = dns_time * 1000;
+    startup_timings_.stage_ms[kZapStageConnect] = connect_time * 1000;
+    startup_timings_.stage_ms[kZapStageTls] = tls_time * 1000;
+    startup_timings_.stage_ms[kZapStageHeaders] = MillisecondsSinceOpen();
     // 20x OK, notify WaitForResponse and continue transfer
     return true;
 }
 
+bool StreamLoader::OnReconnectResponse() {
+    CURL* curl = session_.GetCurlHolder()->handle;
+
+    long status_code = 0;
+    CURLcode ret = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+
+    if (ret == CURLcode::CURLE_OK && status_code >= 400) {
+        // Cancel, PrepareReconnect() decides whether to try again
+        Log::ErrorF("StreamLoader::OnReconnectResponse(): Invalid status code: %d", status_code);
+        return false;
+    }
+
+    CurlShare::Instance().RecordConnection(curl);
+    Log::InfoF("StreamLoader::OnReconnectResponse(): Reconnected, response code: %d", status_code);
+    return true;
+}
+
 bool StreamLoader::OnWriteCallback(std::string data) {
+    return OnReceiveData(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+void StreamLoader::UpdateWatermarks() {
+    // Called from the curl thread, re-evaluated at most once per second
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_watermarks_update_ < std::chrono::seconds(1)) {
+        return;
+    }
+    last_watermarks_update_ = now;
+
+    double kbps = speed_sampler_.LastSecondKBps() * 1024.0 * 8 / 1000;
+    if (kbps <= 0) {
+        // Not measured yet
+        return;
+    }
+
+    std::lock_guard guard(watermarks_mutex_);
+    if (!watermarks_.has_value()) {
+        // Replaced by SetCapacity() in the meantime
+        return;
+    }
+
+    // Ignore jitter below 10% to avoid resizing the buffer back and forth
+    if (std::abs(kbps - watermarks_kbps_) >= watermarks_kbps_ * 0.1) {
+        ApplyWatermarks(kbps);
+    }
+}
+
+void StreamLoader::ApplyWatermarks(double kbps) {
+    // watermarks_mutex_ is held by the caller
+    const BufferWatermarks& watermarks = watermarks_.value();
+    double bytes_per_ms = kbps / 8;
+
+    size_t capacity_bytes = static_cast<size_t>(bytes_per_ms * watermarks.capacity_ms);
+    capacity_bytes = std::clamp(capacity_bytes, chunk_size_, std::max(watermarks.max_bytes, chunk_size_));
+    size_t prebuffer_bytes = std::min(static_cast<size_t>(bytes_per_ms * watermarks.prebuffer_ms), capacity_bytes);
+
+    stream_buffer_->SetCapacity(prebuffer_bytes, capacity_bytes);
+    watermarks_kbps_ = kbps;
+
+    Log::InfoF("StreamLoader::ApplyWatermarks(): %.0f kbps, prebuffer: %zu bytes, capacity: %zu bytes",
+               kbps, prebuffer_bytes, capacity_bytes);
+}
+
+bool StreamLoader::AccountReceive(size_t bytes) {
     if (has_requested_abort_) {
         // return false to cancel the transfer
         return false;
     }
 
-    speed_sampler_.AddBytes(data.size());
+    if (splice_pending_) {
+        Splice();
+    }
+
+    if (receive_callbacks_++ == 0) {
+        first_receive_time_ = std::chrono::steady_clock::now();
+        startup_timings_.stage_ms[kZapStageFirstByte] = MillisecondsSinceOpen();
+    }
+    speed_sampler_.AddBytes(bytes);
 
-    blocking_buffer_.Write(reinterpret_cast<uint8_t*>(data.data()), data.size());
+    if (has_watermarks_) {
+        UpdateWatermarks();
+    }
 
     return true;
 }
 
+bool StreamLoader::OnReceiveData(const uint8_t* data, size_t bytes) {
+    if (!AccountReceive(bytes)) {
+        return false;
+    }
+
+    if (packet_aligned_) {
+        size_t bytes_written = packet_aligner_.Push(data, bytes, *stream_buffer_);
+        if (!startup_reported_ && bytes_written > 0) {
+            ReportStartup();
+        }
+    } else {
+        stream_buffer_->Write(data, bytes);
+        if (!startup_reported_ && speed_sampler_.TotalBytes() >= TsUtils::kPacketSize) {
+            ReportStartup();
+        }
+    }
+
+    return true;
+}
+
+double StreamLoader::MillisecondsSinceOpen() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_time_).count();
+}
+
+void StreamLoader::ReportStartup() {
+    startup_reported_ = true;
+    startup_timings_.stage_ms[kZapStageFirstPacket] = MillisecondsSinceOpen();
+    if (on_startup_) {
+        on_startup_(startup_timings_);
+    }
+}
+
 void StreamLoader::Abort() {
     Log::InfoF("StreamLoader::Abort(): Aborting");
     has_requested_abort_ = true;
-    blocking_buffer_.NotifyExit();
+    stream_buffer_->NotifyExit();
+
+    {
+        // Cut a reconnect backoff short
+        std::lock_guard lock(response_mutex_);
+        response_cv_.notify_all();
+    }
+
+    if (use_reactor_) {
+        // Detaching from the multi handle is immediate, no need to kill the socket
+        StreamReactor::TransferStats reactor_stats = RemoveFromReactor();
+        Log::InfoF("StreamLoader::Abort(): Reactor CPU time: %.3lf ms", reactor_stats.cpu_ns / 1000000.0);
+    } else {
+        if (native_client_) {
+            // Wakes up the native client wherever it waits on the socket
+            native_client_->Cancel();
+        } else if (!has_response_received_) {
+            // If server hasn't returned any response, force kill the underlying socket
+            ForceShutdown();
+        }
+
+        async_response_.wait();
+    }
+
+    StreamBufferStats stats = stream_buffer_->GetStats();
+    Log::InfoF("StreamLoader::Abort(): Consumer wakeups sent: %llu, avoided: %llu, spin hits: %llu",
+               static_cast<unsigned long long>(stats.wakeups_sent),
+               static_cast<unsigned long long>(stats.wakeups_avoided),
+               static_cast<unsigned long long>(stats.spin_hits));
+    Log::InfoF("StreamLoader::Abort(): Overflow discontinuities: %llu, dropped bytes: %llu, spilled bytes: %llu",
+               static_cast<unsigned long long>(stats.discontinuities),
+               static_cast<unsigned long long>(stats.dropped_bytes),
+               static_cast<unsigned long long>(stats.spilled_bytes));
+    Log::InfoF("StreamLoader::Abort(): Purged bytes: %llu", static_cast<unsigned long long>(stats.purged_bytes));
+
+    if (receive_callbacks_ > 0) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - first_receive_time_).count();
+        Log::InfoF("StreamLoader::Abort(): Receive callbacks: %llu, %.0lf/s, %.1lf KiB each",
+                   static_cast<unsigned long long>(receive_callbacks_),
+                   seconds > 0 ? receive_callbacks_ / seconds : 0.0,
+                   speed_sampler_.TotalBytes() / 1024.0 / receive_callbacks_);
+    }
 
-    if (!has_response_received_) {
-        // If server hasn't returned any response, force kill the underlying socket
-        ForceShutdown();
+    if (use_reactor_) {
+        Log::InfoF("StreamLoader::Abort(): Backpressure pauses: %llu",
+                   static_cast<unsigned long long>(pause_count_.load()));
     }
 
-    async_response_.wait();
+    if (reconnect_policy_.has_value()) {
+        Log::InfoF("StreamLoader::Abort(): Stream gaps: %llu, total: %.0lf ms, longest: %.0lf ms",
+                   static_cast<unsigned long long>(gap_count_), gap_total_ms_, gap_max_ms_);
+    }
+
+    if (packet_aligned_) {
+        Log::InfoF("StreamLoader::Abort(): TS resync count: %llu, dropped bytes: %llu, transport errors: %llu (%s scanner)",
+                   static_cast<unsigned long long>(packet_aligner_.ResyncCount()),
+                   static_cast<unsigned long long>(packet_aligner_.DroppedBytes()),
+                   static_cast<unsigned long long>(packet_aligner_.TransportErrorCount()),
+                   TsUtils::SyncScannerName());
+    }
 }
 
 size_t StreamLoader::Read(uint8_t* buffer, size_t expected_bytes) {
-    size_t bytes_read = blocking_buffer_.Read(buffer, expected_bytes);
+    SampleDrainInterval();
+    size_t bytes_read = stream_buffer_->Read(buffer, expected_bytes);
+    ResumeIfPaused();
     return bytes_read;
 }
 
 std::pair<uint8_t*, size_t> StreamLoader::ReadChunkAndRetain() {
-    return blocking_buffer_.ReadChunkAndRetain();
+    SampleDrainInterval();
+    std::pair<uint8_t*, size_t> chunk = stream_buffer_->ReadChunkAndRetain();
+    // The chunk leased before this call has just been released
+    ResumeIfPaused();
+    return chunk;
+}
+
+bool StreamLoader::ShouldPause(size_t incoming_bytes) {
+    size_t writable_bytes = stream_buffer_->WritableBytes();
+    if (writable_bytes < incoming_bytes) {
+        // Write() would block. Even with nothing readable, as a chunk the host still leases
+        // may hold the room: handing it back through ReadChunkAndRetain() resumes the stream.
+        return true;
+    }
+    if (!backpressure_.has_value() || writable_bytes == SIZE_MAX) {
+        return false;
+    }
+
+    size_t readable_bytes = stream_buffer_->ReadableBytes();
+    size_t capacity = readable_bytes + writable_bytes;
+    return readable_bytes * 100 >= capacity * backpressure_->high_watermark_percent;
+}
+
+bool StreamLoader::ShouldResume() {
+    if (!backpressure_.has_value()) {
+        return true;
+    }
+
+    size_t readable_bytes = stream_buffer_->ReadableBytes();
+    size_t writable_bytes = stream_buffer_->WritableBytes();
+    if (writable_bytes == SIZE_MAX) {
+        // Switched to a non-blocking overflow policy while paused
+        return true;
+    }
+
+    size_t capacity = readable_bytes + writable_bytes;
+    return readable_bytes * 100 <= capacity * backpressure_->low_watermark_percent;
+}
+
+void StreamLoader::ResumeIfPaused() {
+    // Staying paused above the low watermark is fine, the host keeps reading while there is data
+    if (use_reactor_ && paused_ && ShouldResume() && paused_.exchange(false)) {
+        StreamReactor::Instance().Resume(session_.GetCurlHolder()->handle);
+    }
+}
+
+void StreamLoader::OnTransferDone(CURLcode result, const StreamReactor::TransferStats& stats) {
+    // Called on the reactor thread, mirrors the completion of session_.Get() in Open()
+    CURL* curl = session_.GetCurlHolder()->handle;
+    long status_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+
+    bool cancelled = result == CURLE_WRITE_ERROR || result == CURLE_ABORTED_BY_CALLBACK;
+    bool has_error = false;
+
+    if (result != CURLE_OK && !cancelled) {
+        has_error = true;
+        Log::ErrorF("StreamLoader::OnTransferDone(): curl failed with error_code: %d, msg = %s",
+                    result,
+                    curl_easy_strerror(result));
+    } else if (status_code >= 400) {
+        has_error = true;
+        Log::ErrorF("StreamLoader::OnTransferDone(): Invalid status code: %d", status_code);
+    }
+
+    if (!has_error && !has_requested_abort_) {
+        Log::InfoF("StreamLoader::OnTransferDone(): Transfer completed, reactor CPU time: %.3lf ms",
+                   stats.cpu_ns / 1000000.0);
+    }
+
+    if (reconnect_policy_.has_value() && has_streamed_) {
+        // The backoff must not hold up the reactor thread, which serves every other stream too
+        std::lock_guard guard(reconnect_mutex_);
+        if (!has_requested_abort_) {
+            reconnect_ = std::async(std::launch::async, [this, has_error] {
+                if (PrepareReconnect()) {
+                    std::lock_guard guard(reconnect_mutex_);
+                    if (!has_requested_abort_) {
+                        StreamReactor::Instance().Add(session_.GetCurlHolder()->handle,
+                                                      [this](CURLcode result, const StreamReactor::TransferStats& stats) {
+                            OnTransferDone(result, stats);
+                        });
+                    }
+                    return;
+                }
+                OnTransferEnded(has_error);
+            });
+            return;
+        }
+    }
+
+    OnTransferEnded(has_error);
+}
+
+void StreamLoader::OnTransferEnded(bool has_error) {
+    if (has_error) {
+        std::lock_guard lock(response_mutex_);
+        has_response_received_ = true;
+        request_failed_ = true;
+        response_cv_.notify_all();
+    }
+
+    if (!has_error && !has_requested_abort_) {
+        has_reached_eof_ = true;
+    }
+}
+
+StreamReactor::TransferStats StreamLoader::RemoveFromReactor() {
+    CURL* curl = session_.GetCurlHolder()->handle;
+    StreamReactor::TransferStats stats = StreamReactor::Instance().Remove(curl);
+
+    while (true) {
+        std::future<void> reconnect;
+        {
+            std::lock_guard guard(reconnect_mutex_);
+            reconnect = std::move(reconnect_);
+        }
+        if (!reconnect.valid()) {
+            break;
+        }
+        // A reconnect may have attached the transfer again in the meantime
+        reconnect.wait();
+        stats = StreamReactor::Instance().Remove(curl);
+    }
+
+    return stats;
+}
+
+bool StreamLoader::PrepareReconnect() {
+    // Curl thread, or a helper thread with the reactor, once a stream that had been flowing has ended
+    const ReconnectPolicy& policy = reconnect_policy_.value();
+
+    if (has_requested_abort_) {
+        return false;
+    }
+    if (policy.max_retries > 0 && reconnect_attempts_ >= policy.max_retries) {
+        Log::ErrorF("StreamLoader::PrepareReconnect(): Giving up after %d attempts", reconnect_attempts_);
+        return false;
+    }
+
+    if (!splice_pending_) {
+        // First attempt since the stream dropped
+        gap_start_ = std::chrono::steady_clock::now();
+        splice_pending_ = true;
+    }
+
+    // In 64 bits and multiplied rather than shifted, so that no policy can overflow it
+    int64_t delay_ms = static_cast<int64_t>(policy.initial_delay_ms) * (int64_t{1} << std::min(reconnect_attempts_, 16));
+    delay_ms = std::max<int64_t>(std::min<int64_t>(delay_ms, policy.max_delay_ms), 0);
+    reconnect_attempts_++;
+    Log::InfoF("StreamLoader::PrepareReconnect(): Reconnecting in %lld ms, attempt %d",
+               static_cast<long long>(delay_ms), reconnect_attempts_);
+
+    std::unique_lock lock(response_mutex_);
+    bool aborted = response_cv_.wait_for(lock, std::chrono::milliseconds(delay_ms), [this] {
+        return has_requested_abort_.load();
+    });
+    if (aborted) {
+        return false;
+    }
+
+    reconnecting_ = true;
+    paused_ = false;
+    return true;
+}
+
+void StreamLoader::Splice() {
+    // The old stream may have ended in the middle of a packet, that packet is dropped
+    // and the new stream is picked up from its first sync byte
+    splice_pending_ = false;
+    reconnect_attempts_ = 0;
+    packet_aligner_.Reset();
+
+    double gap_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gap_start_).count();
+    gap_count_++;
+    gap_total_ms_ += gap_ms;
+    gap_max_ms_ = std::max(gap_max_ms_, gap_ms);
+
+    Log::InfoF("StreamLoader::Splice(): Stream resumed after a %.0lf ms gap", gap_ms);
+}
+
+void StreamLoader::Purge() {
+    size_t purged_bytes = stream_buffer_->Purge();
+    Log::InfoF("StreamLoader::Purge(): %zu bytes purged", purged_bytes);
+    // The host would otherwise wait for data on a paused transfer
+    ResumeIfPaused();
 }
 
 size_t StreamLoader::RemainReadable() {
-    return blocking_buffer_.ReadableBytes();
+    return stream_buffer_->ReadableBytes();
+}
+
+size_t StreamLoader::RemainReadablePackets() {
+    return stream_buffer_->ReadablePackets();
+}
+
+bool StreamLoader::IsReadable() {
+    size_t readable_bytes = stream_buffer_->ReadableBytes();
+    return readable_bytes > 0 && readable_bytes >= stream_buffer_->PrebufferBytes();
 }
 
 bool StreamLoader::IsPolling() {
@@ -244,3 +1007,29 @@ bool StreamLoader::IsPolling() {
 float StreamLoader::GetCurrentSpeedKByte() {
     return speed_sampler_.LastSecondKBps();
 }
+
+std::optional<ChannelProfile> StreamLoader::GetObservedProfile() {
+    // A short tune says little about the channel
+    if (speed_sampler_.TotalBytes() < kMinProfileBytes) {
+        return std::nullopt;
+    }
+
+    ChannelProfile profile;
+    profile.kbps = speed_sampler_.AverageKBps() * 1024.0 * 8 / 1000;
+    profile.drain_interval_ms = drain_interval_ms_;
+    return profile;
+}
+
+void StreamLoader::SampleDrainInterval() {
+    auto now = std::chrono::steady_clock::now();
+
+    if (last_drain_time_ != std::chrono::steady_clock::time_point()) {
+        double interval_ms = std::chrono::duration<double, std::milli>(now - last_drain_time_).count();
+        // Long gaps are the host pausing rather than its cadence
+        if (interval_ms < kMaxDrainIntervalMs) {
+            drain_interval_ms_ = drain_interval_ms_ == 0 ? interval_ms : drain_interval_ms_ * 0.9 + interval_ms * 0.1;
+        }
+    }
+
+    last_drain_time_ = now;
+}
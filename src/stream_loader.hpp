@@ -8,19 +8,28 @@
 #include <cstdint>
 #include <cstddef>
 #include <string>
+#include <map>
 #include <utility>
+#include <vector>
 #include <optional>
+#include <memory>
 #include <future>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
 #include <cpr/response.h>
 #include <cpr/session.h>
-#include "blocking_buffer.hpp"
+#include "stream_buffer.hpp"
+#include "channel_profiles.hpp"
 #include "config.hpp"
+#include "native_http_client.hpp"
 #include "speed_sampler.hpp"
+#include "stream_reactor.hpp"
+#include "ts_packet_aligner.hpp"
+#include "zap_latency.hpp"
 
-class StreamLoader {
+class StreamLoader : private NativeHttpClient::Sink {
 public:
     enum class WaitResult {
         kResultOK,
@@ -28,9 +37,45 @@ public:
         kWaitTimeout,
         kWaitFailed
     };
+    // Network stages of the startup in ms since Open(), kZapStageSetup is left to the caller
+    using StartupCallback = std::function<void(const ZapTimings& timings)>;
 public:
-    StreamLoader(size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count);
-    ~StreamLoader();
+    StreamLoader(StreamBufferType buffer_type, size_t chunk_size, size_t max_chunk_count, size_t min_chunk_count);
+    ~StreamLoader() override;
+    // Deliver whole, sync-byte-aligned TS packets only. Must be called before Open().
+    void SetPacketAligned(bool packet_aligned);
+    void SetWakeupPolicy(const WakeupPolicy& policy);
+    void SetOverflowPolicy(OverflowPolicy policy, uint64_t spill_max_bytes);
+    // Size the buffer in stream time, following the measured bitrate while streaming.
+    // May be called while streaming.
+    void SetWatermarks(const BufferWatermarks& watermarks);
+    // Fixed limits in bytes, replacing the watermarks if any. May be called while streaming.
+    void SetCapacity(size_t prebuffer_bytes, size_t capacity_bytes);
+    // Let curl write straight into the stream buffer instead of going through
+    // cpr's std::string WriteCallback. Must be called before Open().
+    void SetZeroCopyReceive(bool zero_copy_receive);
+    // Called once on the curl thread, as soon as the first complete TS packet has been buffered.
+    // Must be called before Open().
+    void SetStartupCallback(StartupCallback on_startup);
+    // Socket options and curl transfer knobs of the streaming connection. Must be called before Open().
+    void SetSocketTuning(const SocketTuning& tuning);
+    // Reconnect a dropped stream with bounded exponential backoff, keeping the buffered data.
+    // Implies packet alignment so that the new stream is spliced in at a packet boundary.
+    // Must be called before Open().
+    void SetReconnectPolicy(const ReconnectPolicy& policy);
+    // Drive the transfer from the process-wide StreamReactor instead of a thread of its own.
+    // Implies zero-copy receive. Must be called before Open().
+    void SetUseReactor(bool use_reactor);
+    // Pause the transfer above the high watermark and resume it from the host side below the low one,
+    // instead of waiting for room each time the buffer is full. Reactor only: a transfer paused inside
+    // curl_easy_perform() cannot be resumed from another thread. Must be called before Open().
+    void SetBackpressure(const BackpressureConfig& backpressure);
+    // Stream plain-HTTP servers through NativeHttpClient instead of curl, falling back to curl
+    // for https, proxies and the reactor. Must be called before Open().
+    void SetNativeHttp(bool native_http);
+    // Stream over a handle which already holds a connection to the server, see EPGStationAPI::Preconnect().
+    // Not with the reactor, which pools the connections in its multi handle. Must be called before Open().
+    void AdoptSession(std::unique_ptr<cpr::Session> session);
     bool Open(const std::string& base_url,
               const std::string& path_query,
               std::optional<BasicAuth> basic_auth = std::nullopt,
@@ -42,28 +87,125 @@ public:
     WaitResult WaitForData();
     size_t Read(uint8_t* buffer, size_t expected_bytes);
     std::pair<uint8_t*, size_t> ReadChunkAndRetain();
+    // Drop buffered data, delivery restarts on the next TS sync byte
+    void Purge();
     size_t RemainReadable();
+    size_t RemainReadablePackets();
+    // Data has arrived and a read would not wait for the prebuffer
+    bool IsReadable();
     bool IsPolling();
     float GetCurrentSpeedKByte();
+    // Observed bitrate and host read cadence, once enough has been streamed. Call after Abort().
+    std::optional<ChannelProfile> GetObservedProfile();
 private:
     static curl_socket_t OnOpenSocketCallback(StreamLoader* self, curlsocktype purpose, curl_sockaddr* addr);
+    static size_t OnCurlWriteCallback(char* ptr, size_t size, size_t nmemb, StreamLoader* self);
+    static int OnProgressCallback(StreamLoader* self, curl_off_t dltotal, curl_off_t dlnow,
+                                  curl_off_t ultotal, curl_off_t ulnow);
 private:
+    // NativeHttpClient::Sink, on the loader thread
+    void OnNativeSocketOpened(SOCKET sock) override;
+    bool OnNativeResponse(int status_code, const NativeHttpClient::Timings& timings) override;
+    std::pair<uint8_t*, size_t> GetNativeReceiveRegion() override;
+    bool OnNativeData(uint8_t* data, size_t bytes) override;
+private:
+    void OpenNative(const std::string& url, std::map<std::string, std::string> headers);
     void ForceShutdown();
+    void ApplySocketOptions(SOCKET sock);
+    void LogSocketOptions(SOCKET sock);
 private:
     bool OnHeaderCallback(std::string data);
     bool OnWriteCallback(std::string data);
+    bool OnReceiveData(const uint8_t* data, size_t bytes);
+    // Bookkeeping of every receive, returns false once the transfer should be cancelled
+    bool AccountReceive(size_t bytes);
+    void OnTransferDone(CURLcode result, const StreamReactor::TransferStats& stats);
+    // The transfer is over for good, publish the outcome
+    void OnTransferEnded(bool has_error);
+    StreamReactor::TransferStats RemoveFromReactor();
+    // Wait out the backoff, returns false once the loader should give up
+    bool PrepareReconnect();
+    bool OnReconnectResponse();
+    void Splice();
+    bool ShouldPause(size_t incoming_bytes);
+    bool ShouldResume();
+    void ResumeIfPaused();
+    void UpdateWatermarks();
+    void ApplyWatermarks(double kbps);
+    void SampleDrainInterval();
+    double MillisecondsSinceOpen();
+    void ReportStartup();
+private:
+    static constexpr size_t kMinProfileBytes = 2 * 1024 * 1024;
+    static constexpr double kMaxDrainIntervalMs = 1000;
+    static constexpr size_t kNativeReceiveBufferSize = 256 * 1024;
 private:
     size_t chunk_size_;
-    BlockingBuffer blocking_buffer_;
+    std::unique_ptr<StreamBuffer> stream_buffer_;
+
+    bool packet_aligned_ = false;
+    bool zero_copy_receive_ = true;
+    bool use_reactor_ = false;
+    // The write callback has paused the transfer until the host makes room (reactor only)
+    std::atomic<bool> paused_ = false;
+    // Without it the transfer is only paused while the buffer is full, and resumed on every read
+    std::optional<BackpressureConfig> backpressure_;
+    std::atomic<uint64_t> pause_count_ = 0;
+    TsPacketAligner packet_aligner_;
+
+    std::optional<SocketTuning> socket_tuning_;
+
+    bool native_http_ = false;
+    std::unique_ptr<NativeHttpClient> native_client_;
+    // recv() goes straight into the stream buffer when nothing has to be done to the data on the way
+    bool native_direct_receive_ = false;
+    // Receive region of the native client otherwise, only touched from the loader thread
+    std::vector<uint8_t> native_receive_buffer_;
+
+    StartupCallback on_startup_;
+    std::chrono::steady_clock::time_point open_time_;
+    // Only touched from the curl thread
+    ZapTimings startup_timings_;
+    bool startup_reported_ = false;
+    // Receive path statistics, only touched from the curl thread
+    uint64_t receive_callbacks_ = 0;
+    std::chrono::steady_clock::time_point first_receive_time_;
+
+    std::optional<ReconnectPolicy> reconnect_policy_;
+    // A response has been accepted, only a stream that has been flowing is reconnected
+    bool has_streamed_ = false;
+    int reconnect_attempts_ = 0;
+    // The next status line belongs to a reconnect attempt
+    std::atomic<bool> reconnecting_ = false;
+    // The next data received starts the new stream
+    bool splice_pending_ = false;
+    std::chrono::steady_clock::time_point gap_start_;
+    uint64_t gap_count_ = 0;
+    double gap_total_ms_ = 0;
+    double gap_max_ms_ = 0;
+    // With the reactor the backoff runs on a helper thread, guarded by reconnect_mutex_
+    std::mutex reconnect_mutex_;
+    std::future<void> reconnect_;
 
     bool has_requested_ = false;
-    bool has_response_received_ = false;
-    bool has_reached_eof_ = false;
-    bool request_failed_ = false;
+    std::atomic<bool> has_response_received_ = false;
+    std::atomic<bool> has_reached_eof_ = false;
+    std::atomic<bool> request_failed_ = false;
     std::atomic<bool> has_requested_abort_ = false;
 
     SpeedSampler speed_sampler_;
 
+    // Set from the host thread, read on the curl thread
+    std::mutex watermarks_mutex_;
+    std::atomic<bool> has_watermarks_ = false;
+    std::optional<BufferWatermarks> watermarks_;
+    double watermarks_kbps_ = 0;
+    std::chrono::steady_clock::time_point last_watermarks_update_;
+
+    // Host read cadence, only touched from the host thread
+    double drain_interval_ms_ = 0;
+    std::chrono::steady_clock::time_point last_drain_time_;
+
     cpr::Session session_;
     SOCKET socket_ = INVALID_SOCKET;
     std::future<cpr::Response> async_response_;
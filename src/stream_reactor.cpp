@@ -0,0 +1,232 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <time.h>
+#endif
+#include "log.hpp"
+#include "stream_reactor.hpp"
+
+StreamReactor& StreamReactor::Instance() {
+    // Intentionally leaked: no thread is ever joined during static destruction
+    static StreamReactor* instance = new StreamReactor();
+    return *instance;
+}
+
+StreamReactor::StreamReactor() : multi_(curl_multi_init()) {
+    // Concurrent HTTP/2 streams to the same server share one connection
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
+
+void StreamReactor::Add(CURL* easy, Completion on_done) {
+    Command command;
+    command.type = Command::Type::kAdd;
+    command.easy = easy;
+    command.on_done = std::move(on_done);
+    Post(std::move(command));
+}
+
+StreamReactor::TransferStats StreamReactor::Remove(CURL* easy) {
+    Command command;
+    command.type = Command::Type::kRemove;
+    command.easy = easy;
+    std::future<TransferStats> removed = command.removed.get_future();
+    Post(std::move(command));
+    return removed.get();
+}
+
+void StreamReactor::Resume(CURL* easy) {
+    Command command;
+    command.type = Command::Type::kResume;
+    command.easy = easy;
+    Post(std::move(command));
+}
+
+void StreamReactor::Flush() {
+    std::unique_lock locker(mutex_);
+    idle_cv_.wait(locker, [this] {
+        return !running_ || transfer_count_ > 0 || !commands_.empty();
+    });
+
+    if (running_ || !thread_.joinable()) {
+        return;
+    }
+
+    // Wait for the thread to be completely gone, Post() starts a new one if needed
+    std::thread thread = std::move(thread_);
+    locker.unlock();
+    thread.join();
+}
+
+void StreamReactor::Post(Command&& command) {
+    std::lock_guard guard(mutex_);
+    commands_.push_back(std::move(command));
+
+    if (running_) {
+        curl_multi_wakeup(multi_);
+        return;
+    }
+
+    // The previous thread has already left Run() and won't touch mutex_ again
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    running_ = true;
+    thread_ = std::thread(&StreamReactor::Run, this);
+    Log::InfoF("StreamReactor::Post(): Reactor thread started");
+}
+
+void StreamReactor::Run() {
+    while (true) {
+        uint64_t cpu_begin = ThreadCpuNanoseconds();
+
+        if (!ProcessCommands()) {
+            break;
+        }
+
+        int running_transfers = 0;
+        curl_multi_perform(multi_, &running_transfers);
+
+        AccountCpuTime(ThreadCpuNanoseconds() - cpu_begin);
+        CompleteTransfers();
+
+        if (transfers_.empty()) {
+            // Exit right away instead of polling on, unless a command has come in meanwhile
+            continue;
+        }
+
+        curl_multi_poll(multi_, nullptr, 0, kPollTimeoutMs, nullptr);
+    }
+}
+
+bool StreamReactor::ProcessCommands() {
+    std::vector<Command> commands;
+    {
+        std::lock_guard guard(mutex_);
+        if (commands_.empty() && transfers_.empty()) {
+            Log::InfoF("StreamReactor::ProcessCommands(): No transfer left, reactor thread exits");
+            running_ = false;
+            idle_cv_.notify_all();
+            return false;
+        }
+        commands.swap(commands_);
+    }
+
+    for (Command& command : commands) {
+        switch (command.type) {
+            case Command::Type::kAdd: {
+                CURLMcode ret = curl_multi_add_handle(multi_, command.easy);
+                if (ret != CURLM_OK) {
+                    Log::ErrorF("StreamReactor::ProcessCommands(): curl_multi_add_handle() failed, %s",
+                                curl_multi_strerror(ret));
+                    command.on_done(CURLE_FAILED_INIT, TransferStats());
+                    break;
+                }
+                Transfer transfer;
+                transfer.on_done = std::move(command.on_done);
+                transfers_.emplace(command.easy, std::move(transfer));
+                PublishTransferCount();
+                break;
+            }
+            case Command::Type::kRemove: {
+                TransferStats stats;
+                auto iter = transfers_.find(command.easy);
+                if (iter != transfers_.end()) {
+                    curl_multi_remove_handle(multi_, command.easy);
+                    stats = iter->second.stats;
+                    transfers_.erase(iter);
+                    // Before the caller returns, so that a Flush() right after sees the last transfer gone
+                    PublishTransferCount();
+                }
+                // else: already completed
+                command.removed.set_value(stats);
+                break;
+            }
+            case Command::Type::kResume:
+                if (transfers_.count(command.easy) > 0) {
+                    // May call the write callback right away with the data held back
+                    curl_easy_pause(command.easy, CURLPAUSE_CONT);
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+void StreamReactor::CompleteTransfers() {
+    CURLMsg* message = nullptr;
+    int queued = 0;
+
+    while ((message = curl_multi_info_read(multi_, &queued)) != nullptr) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        CURL* easy = message->easy_handle;
+        CURLcode result = message->data.result;
+        curl_multi_remove_handle(multi_, easy);
+
+        auto iter = transfers_.find(easy);
+        if (iter == transfers_.end()) {
+            continue;
+        }
+
+        Transfer transfer = std::move(iter->second);
+        transfers_.erase(iter);
+        PublishTransferCount();
+        transfer.on_done(result, transfer.stats);
+    }
+}
+
+void StreamReactor::PublishTransferCount() {
+    std::lock_guard guard(mutex_);
+    transfer_count_ = transfers_.size();
+}
+
+void StreamReactor::AccountCpuTime(uint64_t cpu_ns) {
+    if (transfers_.empty()) {
+        return;
+    }
+
+    // Split by what each transfer received during this round, evenly if nothing was received
+    std::vector<std::pair<Transfer*, curl_off_t>> deltas;
+    curl_off_t total_delta = 0;
+
+    for (auto& [easy, transfer] : transfers_) {
+        curl_off_t received_bytes = 0;
+        curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &received_bytes);
+        curl_off_t delta = received_bytes - transfer.received_bytes;
+        transfer.received_bytes = received_bytes;
+        deltas.emplace_back(&transfer, delta);
+        total_delta += delta;
+    }
+
+    for (auto& [transfer, delta] : deltas) {
+        if (total_delta > 0) {
+            transfer->stats.cpu_ns += cpu_ns * static_cast<uint64_t>(delta) / static_cast<uint64_t>(total_delta);
+        } else {
+            transfer->stats.cpu_ns += cpu_ns / deltas.size();
+        }
+    }
+}
+
+uint64_t StreamReactor::ThreadCpuNanoseconds() {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        return 0;
+    }
+    auto to_100ns = [](const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (to_100ns(kernel_time) + to_100ns(user_time)) * 100;
+#else
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
@@ -0,0 +1,91 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_STREAM_REACTOR_HPP
+#define BONDRIVER_EPGSTATION_STREAM_REACTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+#include "noncopyable.hpp"
+
+// Process-wide network thread driving every live stream through one curl multi handle,
+// instead of one thread blocked in curl_easy_perform() per tuner.
+// The thread starts with the first transfer and exits once the last one is gone.
+class StreamReactor {
+public:
+    struct TransferStats {
+        // Share of the reactor thread's CPU time, split by bytes received
+        uint64_t cpu_ns = 0;
+    };
+    // Called on the reactor thread once the transfer has finished by itself
+    using Completion = std::function<void(CURLcode result, const TransferStats& stats)>;
+public:
+    static StreamReactor& Instance();
+    void Add(CURL* easy, Completion on_done);
+    // Blocks until the transfer has been detached, on_done is never called afterwards.
+    // Must not be called from the reactor thread.
+    TransferStats Remove(CURL* easy);
+    // Unpause a transfer whose write callback returned CURL_WRITEFUNC_PAUSE
+    void Resume(CURL* easy);
+    // Blocks until the thread has exited if no transfer is left, so that the module can be unloaded.
+    // Returns right away while other transfers keep it running.
+    void Flush();
+private:
+    struct Command {
+        enum class Type {
+            kAdd,
+            kRemove,
+            kResume,
+        };
+        Type type;
+        CURL* easy;
+        Completion on_done;
+        std::promise<TransferStats> removed;
+    };
+    struct Transfer {
+        Completion on_done;
+        curl_off_t received_bytes = 0;
+        TransferStats stats;
+    };
+private:
+    StreamReactor();
+    // Never destroyed, see Instance()
+    ~StreamReactor() = default;
+    void Post(Command&& command);
+    void Run();
+    // Returns false when there is nothing left to do
+    bool ProcessCommands();
+    void CompleteTransfers();
+    void PublishTransferCount();
+    void AccountCpuTime(uint64_t cpu_ns);
+    static uint64_t ThreadCpuNanoseconds();
+private:
+    static constexpr int kPollTimeoutMs = 1000;
+private:
+    CURLM* multi_ = nullptr;
+
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::thread thread_;
+    bool running_ = false;
+    std::vector<Command> commands_;
+    // transfers_.size() as seen from other threads
+    size_t transfer_count_ = 0;
+
+    // Only touched on the reactor thread
+    std::unordered_map<CURL*, Transfer> transfers_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(StreamReactor);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_STREAM_REACTOR_HPP
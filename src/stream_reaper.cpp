@@ -0,0 +1,68 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <chrono>
+#include "log.hpp"
+#include "stream_loader.hpp"
+#include "zap_latency.hpp"
+#include "stream_reaper.hpp"
+
+StreamReaper& StreamReaper::Instance() {
+    // Intentionally leaked: no thread is ever joined during static destruction
+    static StreamReaper* instance = new StreamReaper();
+    return *instance;
+}
+
+void StreamReaper::Reap(std::unique_ptr<StreamLoader> stream_loader, Finalizer on_closed) {
+    std::lock_guard guard(mutex_);
+    jobs_.push_back(Job{std::move(stream_loader), std::move(on_closed)});
+
+    if (running_) {
+        return;
+    }
+
+    // The previous thread has already left Run() and won't touch mutex_ again
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    running_ = true;
+    thread_ = std::thread(&StreamReaper::Run, this);
+}
+
+void StreamReaper::Flush() {
+    std::unique_lock locker(mutex_);
+    idle_cv_.wait(locker, [this] {
+        return !running_;
+    });
+}
+
+void StreamReaper::Run() {
+    while (true) {
+        Job job;
+        {
+            std::lock_guard guard(mutex_);
+            if (jobs_.empty()) {
+                running_ = false;
+                idle_cv_.notify_all();
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+
+        if (job.stream_loader->IsPolling()) {
+            job.stream_loader->Abort();
+        }
+        if (job.on_closed) {
+            job.on_closed(*job.stream_loader);
+        }
+        job.stream_loader.reset();
+
+        double teardown_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        ZapLatency::Instance().RecordTeardown(teardown_ms);
+        Log::InfoF("StreamReaper::Run(): Stream torn down in %.1lf ms", teardown_ms);
+    }
+}
@@ -0,0 +1,52 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_STREAM_REAPER_HPP
+#define BONDRIVER_EPGSTATION_STREAM_REAPER_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "noncopyable.hpp"
+
+class StreamLoader;
+
+// Process-wide thread finishing the shutdown of streams which are no longer needed
+// (abort, curl cleanup, buffer release), so that a channel switch never waits for a
+// slow server to let go. The thread starts with the first stream and exits once idle.
+class StreamReaper {
+public:
+    // Called on the reaper thread once the stream has been aborted, before it is destroyed
+    using Finalizer = std::function<void(StreamLoader& stream_loader)>;
+public:
+    static StreamReaper& Instance();
+    void Reap(std::unique_ptr<StreamLoader> stream_loader, Finalizer on_closed);
+    // Blocks until every stream handed over so far has been destroyed
+    void Flush();
+private:
+    struct Job {
+        std::unique_ptr<StreamLoader> stream_loader;
+        Finalizer on_closed;
+    };
+private:
+    StreamReaper() = default;
+    // Never destroyed, see Instance()
+    ~StreamReaper() = default;
+    void Run();
+private:
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::thread thread_;
+    bool running_ = false;
+    std::deque<Job> jobs_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(StreamReaper);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_STREAM_REAPER_HPP
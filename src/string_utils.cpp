@@ -4,6 +4,7 @@
 
 #include <Windows.h>
 #include <cstddef>
+#include <cstdint>
 #include "string_utils.hpp"
 
 namespace StringUtils {
@@ -47,4 +48,27 @@ std::string RemoveSuffixSlash(const std::string& input) {
     }
 }
 
+std::string Base64Encode(const std::string& input) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((input.size() + 2) / 3 * 4);
+
+    for (size_t i = 0; i < input.size(); i += 3) {
+        size_t remain = input.size() - i;
+        uint32_t bits = static_cast<uint8_t>(input[i]) << 16;
+        if (remain > 1) {
+            bits |= static_cast<uint8_t>(input[i + 1]) << 8;
+        }
+        if (remain > 2) {
+            bits |= static_cast<uint8_t>(input[i + 2]);
+        }
+        result.push_back(kAlphabet[(bits >> 18) & 0x3F]);
+        result.push_back(kAlphabet[(bits >> 12) & 0x3F]);
+        result.push_back(remain > 1 ? kAlphabet[(bits >> 6) & 0x3F] : '=');
+        result.push_back(remain > 2 ? kAlphabet[bits & 0x3F] : '=');
+    }
+
+    return result;
+}
+
 }
@@ -30,6 +30,8 @@ std::string WideStringToUTF8(const std::wstring& input);
 
 std::string RemoveSuffixSlash(const std::string& input);
 
+std::string Base64Encode(const std::string& input);
+
 }
 
 #endif // BONDRIVER_EPGSTATION_STRING_UTILS_HPP
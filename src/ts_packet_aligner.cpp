@@ -0,0 +1,100 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include "ts_packet_aligner.hpp"
+
+using TsUtils::kPacketSize;
+using TsUtils::kSyncByte;
+
+TsPacketAligner::TsPacketAligner() = default;
+
+size_t TsPacketAligner::Push(const uint8_t* data, size_t bytes, StreamBuffer& out) {
+    size_t pos = 0;
+    size_t bytes_written = 0;
+
+    if (carry_size_ > 0) {
+        // Complete the partial packet left by the previous block
+        size_t take = std::min(kPacketSize - carry_size_, bytes);
+        memcpy(carry_ + carry_size_, data, take);
+        carry_size_ += take;
+        pos += take;
+
+        if (carry_size_ < kPacketSize) {
+            return 0;
+        }
+
+        carry_size_ = 0;
+
+        if (pos < bytes && data[pos] != kSyncByte) {
+            // The carried packet isn't followed by a sync byte, it was a false sync
+            Drop(kPacketSize);
+        } else {
+            synced_ = true;
+            TsUtils::ScanPacketRun(carry_, kPacketSize, transport_error_count_);
+            bytes_written += out.Write(carry_, kPacketSize);
+        }
+    }
+
+    while (pos < bytes) {
+        if (data[pos] != kSyncByte) {
+            size_t offset = TsUtils::FindSyncOffset(data + pos, bytes - pos);
+            Drop(offset);
+            pos += offset;
+            continue;
+        }
+
+        // Find the longest run of whole packets and hand it over in one Write()
+        size_t run = TsUtils::ScanPacketRun(data + pos, bytes - pos, transport_error_count_);
+
+        if (run > 0) {
+            synced_ = true;
+            bytes_written += out.Write(data + pos, run);
+            pos += run;
+            continue;
+        }
+
+        // Partial packet at the tail, keep it for the next Push()
+        carry_size_ = bytes - pos;
+        memcpy(carry_, data + pos, carry_size_);
+        pos = bytes;
+    }
+
+    return bytes_written;
+}
+
+void TsPacketAligner::Reset() {
+    dropped_bytes_ += carry_size_;
+    carry_size_ = 0;
+    synced_ = false;
+}
+
+uint64_t TsPacketAligner::ResyncCount() const {
+    return resync_count_;
+}
+
+uint64_t TsPacketAligner::DroppedBytes() const {
+    return dropped_bytes_;
+}
+
+uint64_t TsPacketAligner::TransportErrorCount() const {
+    return transport_error_count_;
+}
+
+void TsPacketAligner::Drop(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    if (synced_) {
+        // Count each loss of sync once, however many blocks it takes to recover.
+        // Skipping garbage before the very first packet isn't a resync.
+        synced_ = false;
+        resync_count_++;
+    }
+
+    dropped_bytes_ += bytes;
+}
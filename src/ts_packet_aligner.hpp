@@ -0,0 +1,43 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_TS_PACKET_ALIGNER_HPP
+#define BONDRIVER_EPGSTATION_TS_PACKET_ALIGNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "noncopyable.hpp"
+#include "stream_buffer.hpp"
+#include "ts_utils.hpp"
+
+// Sits on the producer side of a StreamBuffer and only lets whole, sync-byte-led
+// TS packets through. A partial packet at the end of a block is carried over to
+// the next Push(), and garbage between packets is skipped by resynchronizing.
+class TsPacketAligner {
+public:
+    TsPacketAligner();
+    // Returns the number of bytes written into out
+    size_t Push(const uint8_t* data, size_t bytes, StreamBuffer& out);
+    // Discard the carried partial packet and resynchronize on the next sync byte
+    void Reset();
+    uint64_t ResyncCount() const;
+    uint64_t DroppedBytes() const;
+    // Packets passed through with transport_error_indicator set
+    uint64_t TransportErrorCount() const;
+private:
+    void Drop(size_t bytes);
+private:
+    uint8_t carry_[TsUtils::kPacketSize];
+    size_t carry_size_ = 0;
+    bool synced_ = false;
+
+    uint64_t resync_count_ = 0;
+    uint64_t dropped_bytes_ = 0;
+    uint64_t transport_error_count_ = 0;
+private:
+    DISALLOW_COPY_AND_ASSIGN(TsPacketAligner);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_TS_PACKET_ALIGNER_HPP
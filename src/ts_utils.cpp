@@ -0,0 +1,189 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include "ts_utils.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BONDRIVER_EPGSTATION_TS_SSE2 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define TS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define TS_TARGET_AVX2
+#endif
+
+namespace TsUtils {
+
+// The vector scanners compare data[i], data[i + 188] and data[i + 376] side by side
+static_assert(kSyncLookahead == 2, "Vector sync scanners assume two lookahead packets");
+
+static constexpr size_t kSyncSpan = kSyncLookahead * kPacketSize;
+
+// Reference implementation, also finishes the tail the vector scanners leave over
+static size_t FindSyncOffsetScalar(const uint8_t* data, size_t size, size_t start) {
+    for (size_t i = start; i < size; i++) {
+        if (data[i] != kSyncByte) {
+            continue;
+        }
+
+        bool matched = true;
+
+        for (size_t k = 1; k <= kSyncLookahead; k++) {
+            size_t next = i + k * kPacketSize;
+            if (next >= size) {
+                break;
+            }
+            if (data[next] != kSyncByte) {
+                matched = false;
+                break;
+            }
+        }
+
+        if (matched) {
+            return i;
+        }
+    }
+
+    return size;
+}
+
+#ifdef BONDRIVER_EPGSTATION_TS_SSE2
+
+static inline unsigned CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// While the whole lookahead is inside the buffer, a position is plausible exactly when all
+// three bytes are sync bytes, so the first set bit of the combined mask is the answer.
+// Positions whose lookahead runs past the end are left to the scalar loop.
+static size_t FindSyncOffsetSse2(const uint8_t* data, size_t size) {
+    constexpr size_t kWidth = 16;
+    const __m128i sync = _mm_set1_epi8(static_cast<char>(kSyncByte));
+    size_t i = 0;
+
+    for (; i + kSyncSpan + kWidth <= size; i += kWidth) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + kPacketSize));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + kSyncSpan));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, sync),
+                                   _mm_and_si128(_mm_cmpeq_epi8(b, sync), _mm_cmpeq_epi8(c, sync)));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+        if (mask != 0) {
+            return i + CountTrailingZeros(mask);
+        }
+    }
+
+    return FindSyncOffsetScalar(data, size, i);
+}
+
+TS_TARGET_AVX2
+static size_t FindSyncOffsetAvx2(const uint8_t* data, size_t size) {
+    constexpr size_t kWidth = 32;
+    const __m256i sync = _mm256_set1_epi8(static_cast<char>(kSyncByte));
+    size_t i = 0;
+
+    for (; i + kSyncSpan + kWidth <= size; i += kWidth) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + kPacketSize));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + kSyncSpan));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a, sync),
+                                      _mm256_and_si256(_mm256_cmpeq_epi8(b, sync), _mm256_cmpeq_epi8(c, sync)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+        if (mask != 0) {
+            return i + CountTrailingZeros(mask);
+        }
+    }
+
+    // Finish with 16-byte steps before the scalar tail
+    return i + FindSyncOffsetSse2(data + i, size - i);
+}
+
+static bool CpuHasAvx2() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+    __cpuid(regs, 1);
+    bool os_saves_ymm = (regs[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    bool has_avx = (regs[2] & (1 << 28)) != 0;
+    if (!os_saves_ymm || !has_avx) {
+        return false;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // BONDRIVER_EPGSTATION_TS_SSE2
+
+static size_t FindSyncOffsetReference(const uint8_t* data, size_t size) {
+    return FindSyncOffsetScalar(data, size, 0);
+}
+
+static SyncScanner SelectSyncScanner() {
+#ifdef BONDRIVER_EPGSTATION_TS_SSE2
+    if (CpuHasAvx2()) {
+        return {FindSyncOffsetAvx2, "AVX2"};
+    }
+    return {FindSyncOffsetSse2, "SSE2"};
+#else
+    return {FindSyncOffsetReference, "scalar"};
+#endif
+}
+
+static const SyncScanner& GetSyncScanner() {
+    static const SyncScanner scanner = SelectSyncScanner();
+    return scanner;
+}
+
+size_t FindSyncOffset(const uint8_t* data, size_t size) {
+    return GetSyncScanner().find_sync_offset(data, size);
+}
+
+size_t ScanPacketRun(const uint8_t* data, size_t size, uint64_t& transport_errors) {
+    // Only two bytes per 188 are looked at, a plain strided loop is already memory-bound
+    size_t pos = 0;
+    uint64_t errors = 0;
+
+    while (pos + kPacketSize <= size && data[pos] == kSyncByte) {
+        errors += (data[pos + 1] & kTransportErrorIndicator) != 0;
+        pos += kPacketSize;
+    }
+
+    transport_errors += errors;
+    return pos;
+}
+
+const char* SyncScannerName() {
+    return GetSyncScanner().name;
+}
+
+std::vector<SyncScanner> AvailableSyncScanners() {
+    std::vector<SyncScanner> scanners = {{FindSyncOffsetReference, "scalar"}};
+#ifdef BONDRIVER_EPGSTATION_TS_SSE2
+    scanners.push_back({FindSyncOffsetSse2, "SSE2"});
+    if (CpuHasAvx2()) {
+        scanners.push_back({FindSyncOffsetAvx2, "AVX2"});
+    }
+#endif
+    return scanners;
+}
+
+}
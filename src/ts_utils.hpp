@@ -0,0 +1,45 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_TS_UTILS_HPP
+#define BONDRIVER_EPGSTATION_TS_UTILS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TsUtils {
+
+constexpr size_t kPacketSize = 188;
+constexpr uint8_t kSyncByte = 0x47;
+// transport_error_indicator, top bit of the second header byte
+constexpr uint8_t kTransportErrorIndicator = 0x80;
+// How many following packets must also start with a sync byte to accept a sync position
+constexpr size_t kSyncLookahead = 2;
+
+// Returns the offset of the first plausible packet start in data, or size if there is none.
+// A position is plausible if it holds a sync byte and so do the next kSyncLookahead packet
+// positions that are still inside the buffer.
+// Uses SSE2 / AVX2 where the CPU has them, picked once at runtime.
+size_t FindSyncOffset(const uint8_t* data, size_t size);
+
+// Returns the length of the run of whole packets at the start of data that all begin with a
+// sync byte, and adds the number of those with transport_error_indicator set to transport_errors.
+size_t ScanPacketRun(const uint8_t* data, size_t size, uint64_t& transport_errors);
+
+// Name of the FindSyncOffset() implementation in use, for logging
+const char* SyncScannerName();
+
+struct SyncScanner {
+    size_t (*find_sync_offset)(const uint8_t* data, size_t size);
+    const char* name;
+};
+
+// Every FindSyncOffset() implementation the CPU can run, the scalar reference first.
+// For tests and benchmarks, FindSyncOffset() picks the fastest of them.
+std::vector<SyncScanner> AvailableSyncScanners();
+
+}
+
+#endif // BONDRIVER_EPGSTATION_TS_UTILS_HPP
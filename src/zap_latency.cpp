@@ -0,0 +1,140 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "log.hpp"
+#include "zap_latency.hpp"
+
+ZapLatency& ZapLatency::Instance() {
+    static ZapLatency instance;
+    return instance;
+}
+
+const char* ZapLatency::StageName(ZapStage stage) {
+    static const char* kStageNames[kZapStageCount] = {
+        "setup",
+        "dns",
+        "connect",
+        "tls",
+        "headers",
+        "first byte",
+        "first packet",
+    };
+    return kStageNames[stage];
+}
+
+void ZapLatency::Record(int64_t channel_id, const ZapTimings& timings) {
+    Log::InfoF("ZapLatency::Record(): Channel %lld, setup: %.1lf ms, dns: %.1lf ms, connect: %.1lf ms, tls: %.1lf ms, "
+               "headers: %.1lf ms, first byte: %.1lf ms, first packet: %.1lf ms",
+               static_cast<long long>(channel_id),
+               timings.stage_ms[kZapStageSetup], timings.stage_ms[kZapStageDns],
+               timings.stage_ms[kZapStageConnect], timings.stage_ms[kZapStageTls],
+               timings.stage_ms[kZapStageHeaders], timings.stage_ms[kZapStageFirstByte],
+               timings.stage_ms[kZapStageFirstPacket]);
+
+    std::lock_guard guard(mutex_);
+    std::deque<ZapTimings>& zaps = zaps_[channel_id];
+    zaps.push_back(timings);
+    if (zaps.size() > kWindowSize) {
+        zaps.pop_front();
+    }
+}
+
+std::optional<std::array<LatencyPercentiles, kZapStageCount>> ZapLatency::Get(int64_t channel_id) {
+    std::lock_guard guard(mutex_);
+
+    auto iter = zaps_.find(channel_id);
+    if (iter == zaps_.end()) {
+        return std::nullopt;
+    }
+
+    return ComputeStages(iter->second);
+}
+
+void ZapLatency::RecordTeardown(double teardown_ms) {
+    std::lock_guard guard(mutex_);
+    teardowns_.push_back(teardown_ms);
+    if (teardowns_.size() > kWindowSize) {
+        teardowns_.pop_front();
+    }
+}
+
+LatencyPercentiles ZapLatency::GetTeardown() {
+    std::lock_guard guard(mutex_);
+    return ComputePercentiles(std::vector<double>(teardowns_.begin(), teardowns_.end()));
+}
+
+void ZapLatency::RecordSwitchGap(double gap_ms) {
+    std::lock_guard guard(mutex_);
+    switch_gaps_.push_back(gap_ms);
+    if (switch_gaps_.size() > kWindowSize) {
+        switch_gaps_.pop_front();
+    }
+}
+
+LatencyPercentiles ZapLatency::GetSwitchGap() {
+    std::lock_guard guard(mutex_);
+    return ComputePercentiles(std::vector<double>(switch_gaps_.begin(), switch_gaps_.end()));
+}
+
+void ZapLatency::Dump() {
+    std::lock_guard guard(mutex_);
+
+    LatencyPercentiles teardown = ComputePercentiles(std::vector<double>(teardowns_.begin(), teardowns_.end()));
+    Log::InfoF("ZapLatency::Dump(): Teardown: p50 %.1lf ms, p95 %.1lf ms, p99 %.1lf ms (%zu streams)",
+               teardown.p50, teardown.p95, teardown.p99, teardown.count);
+
+    if (!switch_gaps_.empty()) {
+        LatencyPercentiles switch_gap = ComputePercentiles(std::vector<double>(switch_gaps_.begin(), switch_gaps_.end()));
+        Log::InfoF("ZapLatency::Dump(): Switch gap: p50 %.1lf ms, p95 %.1lf ms, p99 %.1lf ms (%zu switches)",
+                   switch_gap.p50, switch_gap.p95, switch_gap.p99, switch_gap.count);
+    }
+
+    for (auto& [channel_id, zaps] : zaps_) {
+        std::array<LatencyPercentiles, kZapStageCount> percentiles = ComputeStages(zaps);
+        for (int stage = 0; stage < kZapStageCount; stage++) {
+            const LatencyPercentiles& stage_percentiles = percentiles[stage];
+            Log::InfoF("ZapLatency::Dump(): Channel %lld, %s: p50 %.1lf ms, p95 %.1lf ms, p99 %.1lf ms (%zu zaps)",
+                       static_cast<long long>(channel_id), StageName(static_cast<ZapStage>(stage)),
+                       stage_percentiles.p50, stage_percentiles.p95, stage_percentiles.p99, stage_percentiles.count);
+        }
+    }
+}
+
+LatencyPercentiles ZapLatency::ComputePercentiles(std::vector<double> samples) {
+    LatencyPercentiles percentiles;
+    percentiles.count = samples.size();
+    if (samples.empty()) {
+        return percentiles;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    // Nearest rank
+    auto rank = [&samples](double percent) {
+        size_t index = static_cast<size_t>(std::ceil(percent / 100 * samples.size()));
+        return samples[std::clamp<size_t>(index, 1, samples.size()) - 1];
+    };
+
+    percentiles.p50 = rank(50);
+    percentiles.p95 = rank(95);
+    percentiles.p99 = rank(99);
+    return percentiles;
+}
+
+std::array<LatencyPercentiles, kZapStageCount> ZapLatency::ComputeStages(const std::deque<ZapTimings>& zaps) {
+    std::array<LatencyPercentiles, kZapStageCount> percentiles;
+
+    for (int stage = 0; stage < kZapStageCount; stage++) {
+        std::vector<double> samples;
+        samples.reserve(zaps.size());
+        for (const ZapTimings& zap : zaps) {
+            samples.push_back(zap.stage_ms[stage]);
+        }
+        percentiles[stage] = ComputePercentiles(std::move(samples));
+    }
+
+    return percentiles;
+}
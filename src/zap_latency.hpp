@@ -0,0 +1,77 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_ZAP_LATENCY_HPP
+#define BONDRIVER_EPGSTATION_ZAP_LATENCY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "noncopyable.hpp"
+
+// Stages of a channel switch, each one in ms since SetChannel() was entered
+enum ZapStage {
+    // The previous stream has been torn down, the request is about to go out
+    kZapStageSetup = 0,
+    kZapStageDns,
+    kZapStageConnect,
+    kZapStageTls,
+    // Response headers received, i.e. EPGStation has started its tuner
+    kZapStageHeaders,
+    kZapStageFirstByte,
+    // First complete TS packet in the stream buffer
+    kZapStageFirstPacket,
+    kZapStageCount,
+};
+
+struct ZapTimings {
+    std::array<double, kZapStageCount> stage_ms = {};
+};
+
+struct LatencyPercentiles {
+    size_t count = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+};
+
+// Rolling per-channel record of the last zaps, keyed by Channel::id.
+// Shared by every tuner in the process.
+class ZapLatency {
+public:
+    static ZapLatency& Instance();
+    static const char* StageName(ZapStage stage);
+    void Record(int64_t channel_id, const ZapTimings& timings);
+    // Per stage percentiles over the recorded window of the channel
+    std::optional<std::array<LatencyPercentiles, kZapStageCount>> Get(int64_t channel_id);
+    // Background shutdown of a stream that is no longer needed, see StreamReaper
+    void RecordTeardown(double teardown_ms);
+    LatencyPercentiles GetTeardown();
+    // Time the host went without data across a make-before-break switch
+    void RecordSwitchGap(double gap_ms);
+    LatencyPercentiles GetSwitchGap();
+    // Log the percentiles of every channel seen so far, of the teardowns and of the switch gaps
+    void Dump();
+private:
+    ZapLatency() = default;
+    static LatencyPercentiles ComputePercentiles(std::vector<double> samples);
+    static std::array<LatencyPercentiles, kZapStageCount> ComputeStages(const std::deque<ZapTimings>& zaps);
+private:
+    static constexpr size_t kWindowSize = 128;
+private:
+    std::mutex mutex_;
+    std::map<int64_t, std::deque<ZapTimings>> zaps_;
+    std::deque<double> teardowns_;
+    std::deque<double> switch_gaps_;
+private:
+    DISALLOW_COPY_AND_ASSIGN(ZapLatency);
+};
+
+
+#endif // BONDRIVER_EPGSTATION_ZAP_LATENCY_HPP
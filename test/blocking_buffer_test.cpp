@@ -0,0 +1,213 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstdint>
+#include <chrono>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+#include "blocking_buffer.hpp"
+#include "spill_file.hpp"
+#include "test_utils.hpp"
+
+static constexpr size_t kChunkSize = 188 * 64;
+static constexpr size_t kMaxChunkCount = 8;
+
+// Streams bytes through the buffer with a consumer thread leasing chunks, returns false on corruption
+static bool StreamThrough(BlockingBuffer& buffer, size_t total_bytes, uint32_t seed) {
+    bool intact = true;
+
+    std::thread consumer([&buffer, total_bytes, &intact] {
+        uint8_t expected = 0;
+        size_t received = 0;
+        while (received < total_bytes) {
+            buffer.WaitUntilData();
+            auto [data, bytes] = buffer.ReadChunkAndRetain();
+            for (size_t i = 0; i < bytes; i++) {
+                intact = intact && data[i] == expected++;
+            }
+            received += bytes;
+        }
+    });
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> block(kChunkSize * 2);
+    uint8_t next = 0;
+    size_t sent = 0;
+
+    while (sent < total_bytes) {
+        size_t bytes = std::min<size_t>(1 + rng() % block.size(), total_bytes - sent);
+        for (size_t i = 0; i < bytes; i++) {
+            block[i] = next++;
+        }
+        sent += buffer.Write(block.data(), bytes);
+    }
+
+    consumer.join();
+    return intact;
+}
+
+static bool TestSteadyStateStopsAllocating() {
+    BlockingBuffer buffer(kChunkSize, kMaxChunkCount);
+
+    // Warm up: the deque at its limit plus a leased chunk is the most ever alive at once
+    std::vector<uint8_t> fill(kChunkSize * kMaxChunkCount, 0);
+    EXPECT(buffer.Write(fill.data(), fill.size()) == fill.size());
+    size_t drained = 0;
+    while (drained < fill.size()) {
+        drained += buffer.ReadChunkAndRetain().second;
+    }
+    EXPECT(buffer.Write(fill.data(), fill.size()) == fill.size());
+    drained = 0;
+    while (drained < fill.size()) {
+        drained += buffer.ReadChunkAndRetain().second;
+    }
+
+    size_t warm_allocations = buffer.ChunkAllocationCount();
+    EXPECT(warm_allocations <= kMaxChunkCount + 1);
+
+    EXPECT(StreamThrough(buffer, 64 * 1024 * 1024, 1));
+    EXPECT(buffer.ChunkAllocationCount() == warm_allocations);
+    return true;
+}
+
+static bool TestShrinkKeepsStreaming() {
+    BlockingBuffer buffer(kChunkSize, kMaxChunkCount);
+    EXPECT(StreamThrough(buffer, 8 * 1024 * 1024, 2));
+
+    // Trims the pool to the new limit, which must then hold for the rest of the stream
+    buffer.SetCapacity(0, kChunkSize * 2);
+    size_t shrunk_allocations = buffer.ChunkAllocationCount();
+    EXPECT(StreamThrough(buffer, 8 * 1024 * 1024, 3));
+    EXPECT(buffer.ChunkAllocationCount() == shrunk_allocations);
+    return true;
+}
+
+static bool TestWakeupsAreCoalesced() {
+    constexpr size_t kWriteBytes = 1024;
+    constexpr size_t kBurstWrites = 12;
+    constexpr size_t kBurstCount = 20;
+    BlockingBuffer buffer(kChunkSize, 256, 1);
+
+    WakeupPolicy policy;
+    policy.bytes = 8 * kWriteBytes;
+    buffer.SetWakeupPolicy(policy);
+
+    // Like a host, drain everything then go away for a while. Bytes written meanwhile
+    // must not count towards the next wakeup, else the first write after parking wakes it.
+    size_t min_woken_bytes = SIZE_MAX;
+    std::thread consumer([&buffer, &min_woken_bytes] {
+        while (true) {
+            bool parks = buffer.ReadableBytes() == 0;
+            buffer.WaitUntilData();
+            if (buffer.IsExit()) {
+                break;
+            }
+            if (parks) {
+                min_woken_bytes = std::min(min_woken_bytes, buffer.ReadableBytes());
+            }
+            while (buffer.ReadableBytes() > 0) {
+                buffer.ReadChunkAndRetain();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // Bursts of writes with gaps long enough for the consumer to run dry and park
+    std::vector<uint8_t> block(kWriteBytes, 0x47);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (size_t burst = 0; burst < kBurstCount; burst++) {
+        for (size_t i = 0; i < kBurstWrites; i++) {
+            buffer.Write(block.data(), block.size());
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    buffer.NotifyExit();
+    consumer.join();
+
+    EXPECT(min_woken_bytes >= policy.bytes);
+    return true;
+}
+
+static bool TestSpillFileWrapsAround() {
+    constexpr uint64_t kCapacity = 1000;
+    SpillFile spill(kCapacity);
+    std::mt19937 rng(4);
+    uint8_t next_write = 0;
+    uint8_t next_read = 0;
+    uint64_t total_written = 0;
+
+    // Never drains completely, so every byte after the first 1000 goes through the wrap-around
+    while (total_written < 100 * kCapacity) {
+        uint8_t block[300];
+        size_t write_bytes = std::min<uint64_t>(1 + rng() % sizeof(block), kCapacity - spill.Size());
+        for (size_t i = 0; i < write_bytes; i++) {
+            block[i] = next_write++;
+        }
+        EXPECT(spill.Write(block, write_bytes));
+        total_written += write_bytes;
+        if (spill.Size() == kCapacity) {
+            EXPECT(!spill.Write(block, 1));
+        }
+
+        size_t read_bytes = static_cast<size_t>(std::min<uint64_t>(1 + rng() % sizeof(block), spill.Size() - 1));
+        EXPECT(spill.Read(block, read_bytes) == read_bytes);
+        for (size_t i = 0; i < read_bytes; i++) {
+            EXPECT(block[i] == next_read++);
+        }
+    }
+
+    return true;
+}
+
+static bool TestSpillKeepsOrder() {
+    BlockingBuffer buffer(kChunkSize, 2);
+    buffer.SetOverflowPolicy(kOverflowPolicySpillToDisk, kChunkSize * 4);
+    EXPECT(StreamThrough(buffer, 32 * 1024 * 1024, 5));
+    EXPECT(buffer.GetStats().spilled_bytes > 0);
+    return true;
+}
+
+// A producer parked on a full buffer must go on once the policy stops blocking, with nobody consuming
+static bool TestPolicyChangeReleasesProducer() {
+    BlockingBuffer buffer(kChunkSize, 2);
+    std::vector<uint8_t> block(kChunkSize, 0x47);
+    buffer.Write(block.data(), block.size());
+    buffer.Write(block.data(), block.size());
+
+    std::promise<size_t> written;
+    std::future<size_t> result = written.get_future();
+    std::thread producer([&buffer, &block, &written] {
+        written.set_value(buffer.Write(block.data(), block.size()));
+    });
+
+    // Give it time to park
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    buffer.SetOverflowPolicy(kOverflowPolicyDropOldest, 0);
+
+    bool released = result.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    if (!released) {
+        buffer.NotifyExit();
+    }
+    producer.join();
+
+    EXPECT(released);
+    EXPECT(result.get() == block.size());
+    EXPECT(buffer.ReadableBytes() == kChunkSize * 2);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int failures = 0;
+    RUN_TEST(TestSteadyStateStopsAllocating, failures);
+    RUN_TEST(TestShrinkKeepsStreaming, failures);
+    RUN_TEST(TestWakeupsAreCoalesced, failures);
+    RUN_TEST(TestSpillFileWrapsAround, failures);
+    RUN_TEST(TestSpillKeepsOrder, failures);
+    RUN_TEST(TestPolicyChangeReleasesProducer, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "chunked_decoder.hpp"
+#include "test_utils.hpp"
+
+// Feeds encoded in pieces of at most piece_bytes, as if each came from one recv(), and returns the payload
+static std::string Decode(ChunkedDecoder& decoder, const std::string& encoded, size_t piece_bytes) {
+    std::string payload;
+    std::vector<uint8_t> region;
+
+    for (size_t pos = 0; pos < encoded.size(); pos += piece_bytes) {
+        size_t bytes = std::min(piece_bytes, encoded.size() - pos);
+        region.assign(encoded.begin() + pos, encoded.begin() + pos + bytes);
+        size_t payload_bytes = decoder.Decode(region.data(), bytes);
+        payload.append(reinterpret_cast<const char*>(region.data()), payload_bytes);
+    }
+
+    return payload;
+}
+
+static std::string Decode(const std::string& encoded, size_t piece_bytes, bool* done, bool* error) {
+    ChunkedDecoder decoder;
+    std::string payload = Decode(decoder, encoded, piece_bytes);
+    *done = decoder.IsDone();
+    *error = decoder.IsError();
+    return payload;
+}
+
+// Every way of splitting the message, from one piece down to one byte per recv()
+static bool ExpectDecodes(const std::string& encoded, const std::string& expected) {
+    for (size_t piece_bytes = 1; piece_bytes <= encoded.size(); piece_bytes++) {
+        bool done = false;
+        bool error = false;
+        std::string payload = Decode(encoded, piece_bytes, &done, &error);
+        EXPECT(payload == expected);
+        EXPECT(done);
+        EXPECT(!error);
+    }
+
+    // Split once at every position
+    for (size_t split = 0; split <= encoded.size(); split++) {
+        ChunkedDecoder decoder;
+        std::string payload = Decode(decoder, encoded.substr(0, split), encoded.size() + 1);
+        payload += Decode(decoder, encoded.substr(split), encoded.size() + 1);
+        EXPECT(payload == expected);
+        EXPECT(decoder.IsDone());
+    }
+    return true;
+}
+
+static bool ExpectMalformed(const std::string& encoded) {
+    for (size_t piece_bytes = 1; piece_bytes <= encoded.size(); piece_bytes++) {
+        bool done = false;
+        bool error = false;
+        Decode(encoded, piece_bytes, &done, &error);
+        EXPECT(error);
+        EXPECT(!done);
+    }
+    return true;
+}
+
+static bool TestSplitAcrossReceives() {
+    EXPECT(ExpectDecodes("4\r\nWiki\r\n5\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\n\r\n",
+                         "Wikipedia in\r\n\r\nchunks."));
+    EXPECT(ExpectDecodes("1a\r\nabcdefghijklmnopqrstuvwxyz\r\n1A\r\nABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n0\r\n\r\n",
+                         "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+    // Bare LF line endings
+    EXPECT(ExpectDecodes("3\nabc\n0\n\n", "abc"));
+    // Leading zeros, and an empty message
+    EXPECT(ExpectDecodes("0003\r\nabc\r\n0\r\n\r\n", "abc"));
+    EXPECT(ExpectDecodes("0\r\n\r\n", ""));
+    return true;
+}
+
+static bool TestExtensions() {
+    EXPECT(ExpectDecodes("4;name=value\r\nWiki\r\n5 ; quoted=\"a;b\"\r\npedia\r\n0;last\r\n\r\n", "Wikipedia"));
+    EXPECT(ExpectDecodes("4\t;x\r\nWiki\r\n0\r\n\r\n", "Wiki"));
+    return true;
+}
+
+static bool TestTrailers() {
+    EXPECT(ExpectDecodes("4\r\nWiki\r\n0\r\nExpires: Wed, 21 Oct 2015 07:28:00 GMT\r\nX-Foo: bar\r\n\r\n", "Wiki"));
+    EXPECT(ExpectDecodes("4\nWiki\n0\nX-Foo: bar\n\n", "Wiki"));
+    return true;
+}
+
+static bool TestMalformed() {
+    // Not a hex digit
+    EXPECT(ExpectMalformed("g\r\nabc\r\n0\r\n\r\n"));
+    EXPECT(ExpectMalformed("0x4\r\nWiki\r\n0\r\n\r\n"));
+    // A size line without a size
+    EXPECT(ExpectMalformed("\r\nWiki\r\n0\r\n\r\n"));
+    EXPECT(ExpectMalformed(";ext\r\nWiki\r\n0\r\n\r\n"));
+    EXPECT(ExpectMalformed("4\r\nWiki\r\n\r\n"));
+    // More data than announced
+    EXPECT(ExpectMalformed("3\r\nWiki\r\n0\r\n\r\n"));
+    // CR not followed by LF
+    EXPECT(ExpectMalformed("4\rWiki\r\n0\r\n\r\n"));
+    EXPECT(ExpectMalformed("4\r\nWiki\rX0\r\n\r\n"));
+    // Larger than 64 bits
+    EXPECT(ExpectMalformed("11111111111111111\r\n"));
+    return true;
+}
+
+static bool TestStopsAtEnd() {
+    ChunkedDecoder decoder;
+    std::string payload = Decode(decoder, "3\r\nabc\r\n0\r\n\r\n3\r\ndef\r\n", 1024);
+    EXPECT(payload == "abc");
+    EXPECT(decoder.IsDone());
+
+    decoder.Reset();
+    EXPECT(!decoder.IsDone());
+    EXPECT(Decode(decoder, "3\r\nghi\r\n0\r\n\r\n", 1024) == "ghi");
+    EXPECT(decoder.IsDone());
+    return true;
+}
+
+// Random chunk sizes with optional extensions, fed at random recv() sizes
+static bool TestRandomMessages() {
+    std::mt19937 rng(3);
+
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        std::string expected;
+        std::string encoded;
+        char size_line[32];
+
+        int chunks = rng() % 16;
+        for (int i = 0; i < chunks; i++) {
+            size_t size = 1 + rng() % 5000;
+            snprintf(size_line, sizeof(size_line), rng() % 2 ? "%zx" : "%zX", size);
+            encoded += size_line;
+            if (rng() % 4 == 0) {
+                encoded += ";n=v";
+            }
+            encoded += "\r\n";
+
+            std::string data(size, '\0');
+            for (char& c : data) {
+                c = static_cast<char>(rng());
+            }
+            expected += data;
+            encoded += data + "\r\n";
+        }
+        encoded += rng() % 2 ? "0\r\n\r\n" : "0\r\nX-Trailer: 1\r\n\r\n";
+
+        ChunkedDecoder decoder;
+        std::string payload;
+        for (size_t pos = 0; pos < encoded.size();) {
+            size_t bytes = std::min<size_t>(1 + rng() % 3000, encoded.size() - pos);
+            payload += Decode(decoder, encoded.substr(pos, bytes), bytes);
+            pos += bytes;
+        }
+        EXPECT(payload == expected);
+        EXPECT(decoder.IsDone());
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int failures = 0;
+    RUN_TEST(TestSplitAcrossReceives, failures);
+    RUN_TEST(TestExtensions, failures);
+    RUN_TEST(TestTrailers, failures);
+    RUN_TEST(TestMalformed, failures);
+    RUN_TEST(TestStopsAtEnd, failures);
+    RUN_TEST(TestRandomMessages, failures);
+    return failures == 0 ? 0 : 1;
+}
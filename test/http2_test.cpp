@@ -0,0 +1,172 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+// Streams driven by the reactor with http2: true, against a local h2c stand-in server:
+//
+//   nghttpd --no-tls 8443 -d <directory with a file of a few MB>
+//   BonDriver_EPGStation_http2_test http://127.0.0.1:8443/<file>
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <curl/curl.h>
+#include "curl_share.hpp"
+#include "stream_reactor.hpp"
+#include "test_utils.hpp"
+
+static constexpr size_t kStreamCount = 4;
+static constexpr auto kTimeout = std::chrono::seconds(30);
+
+static std::string test_url;
+
+struct Transfer {
+    CURL* easy = nullptr;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<bool> done = false;
+    std::atomic<bool> hold = false;
+    std::atomic<bool> paused = false;
+    CURLcode result = CURLE_OK;
+    long http_version = 0;
+    long new_connections = 0;
+};
+
+static size_t OnWrite(char* /*ptr*/, size_t size, size_t nmemb, Transfer* transfer) {
+    if (transfer->hold) {
+        // Like StreamLoader with a full buffer, the stream's flow control window closes
+        transfer->paused = true;
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    transfer->bytes += size * nmemb;
+    return size * nmemb;
+}
+
+// Adds every transfer to the reactor the way StreamLoader::Open() does with http2: true
+static void Start(std::vector<Transfer>& transfers, const std::string& url) {
+    for (Transfer& transfer : transfers) {
+        transfer.easy = curl_easy_init();
+        CurlShare::Instance().Attach(transfer.easy);
+        curl_easy_setopt(transfer.easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(transfer.easy, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(transfer.easy, CURLOPT_WRITEFUNCTION, OnWrite);
+        curl_easy_setopt(transfer.easy, CURLOPT_WRITEDATA, &transfer);
+
+        StreamReactor::Instance().Add(transfer.easy, [&transfer](CURLcode result, const StreamReactor::TransferStats&) {
+            transfer.result = result;
+            curl_easy_getinfo(transfer.easy, CURLINFO_HTTP_VERSION, &transfer.http_version);
+            curl_easy_getinfo(transfer.easy, CURLINFO_NUM_CONNECTS, &transfer.new_connections);
+            transfer.done = true;
+        });
+    }
+}
+
+// Waits until pred holds or the timeout has passed
+template <typename Predicate>
+static bool WaitFor(Predicate pred) {
+    auto deadline = std::chrono::steady_clock::now() + kTimeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void Cleanup(std::vector<Transfer>& transfers) {
+    for (Transfer& transfer : transfers) {
+        StreamReactor::Instance().Remove(transfer.easy);
+        curl_easy_cleanup(transfer.easy);
+    }
+    StreamReactor::Instance().Flush();
+}
+
+// PIPEWAIT makes the concurrent streams wait for the first connection and multiplex over it
+static bool TestStreamsShareOneConnection() {
+    std::vector<Transfer> transfers(kStreamCount);
+    Start(transfers, test_url);
+
+    bool completed = WaitFor([&transfers] {
+        for (Transfer& transfer : transfers) {
+            if (!transfer.done) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    long new_connections = 0;
+    for (Transfer& transfer : transfers) {
+        new_connections += transfer.new_connections;
+    }
+    uint64_t first_bytes = transfers[0].bytes;
+
+    bool ok = completed;
+    for (Transfer& transfer : transfers) {
+        ok = ok && transfer.result == CURLE_OK && transfer.http_version == CURL_HTTP_VERSION_2_0 &&
+             transfer.bytes == first_bytes;
+    }
+    Cleanup(transfers);
+
+    EXPECT(ok);
+    EXPECT(first_bytes > 0);
+    // 0 if the reactor kept the connection of an earlier run
+    EXPECT(new_connections <= 1);
+    return true;
+}
+
+// A paused stream must not hold up the others sharing its connection
+static bool TestPausedStreamDoesNotStallOthers() {
+    std::vector<Transfer> transfers(kStreamCount);
+    transfers[0].hold = true;
+    Start(transfers, test_url);
+
+    bool others_completed = WaitFor([&transfers] {
+        for (size_t i = 1; i < transfers.size(); i++) {
+            if (!transfers[i].done) {
+                return false;
+            }
+        }
+        return true;
+    });
+    bool held = !transfers[0].done;
+
+    transfers[0].hold = false;
+    if (transfers[0].paused.exchange(false)) {
+        StreamReactor::Instance().Resume(transfers[0].easy);
+    }
+    bool resumed = WaitFor([&transfers] {
+        return transfers[0].done.load();
+    });
+
+    bool ok = transfers[0].result == CURLE_OK && transfers[0].bytes == transfers[1].bytes;
+    Cleanup(transfers);
+
+    EXPECT(others_completed);
+    EXPECT(held);
+    EXPECT(resumed);
+    EXPECT(ok);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <url on an h2c server>\n", argv[0]);
+        return 2;
+    }
+    test_url = argv[1];
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    // As CreateBonDriver() does for a plain http baseURL
+    CurlShare::Instance().SetHttpVersion(CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+
+    int failures = 0;
+    RUN_TEST(TestStreamsShareOneConnection, failures);
+    RUN_TEST(TestPausedStreamDoesNotStallOthers, failures);
+
+    curl_global_cleanup();
+    return failures == 0 ? 0 : 1;
+}
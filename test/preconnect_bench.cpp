@@ -0,0 +1,162 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+// Time to first byte of the first tune, with and without the preconnect OpenTuner() starts:
+//
+//   BonDriver_EPGStation_preconnect_bench <url> [--preconnect-url URL] [--rounds N]
+//
+// Every round starts from an empty share set up like CurlShare (DNS cache and TLS sessions).
+// With preconnect, a HEAD request to --preconnect-url (default: <url>) goes first, as
+// EPGStationAPI::Preconnect() does with /api/config. The GET is then timed on the same handle,
+// which the first StreamLoader adopts, so that it goes out on the connection left open.
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+
+struct Timings {
+    bool ok = false;
+    double dns_ms = 0;
+    double connect_ms = 0;
+    double tls_ms = 0;
+    double ttfb_ms = 0;
+};
+
+static size_t OnDiscard(char* /*ptr*/, size_t /*size*/, size_t /*nmemb*/, void* /*userdata*/) {
+    // Only the first byte matters, abort the rest of a live stream
+    return 0;
+}
+
+static CURLSH* CreateShare() {
+    CURLSH* share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return share;
+}
+
+static bool Preconnect(CURL* curl, const std::string& url) {
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS, 200L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 3000L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 5000L);
+
+    CURLcode code = curl_easy_perform(curl);
+
+    // Like EPGStationAPI::Preconnect(), the stream must not inherit the limits of the HEAD request
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 0L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 0L);
+    return code == CURLE_OK;
+}
+
+static Timings Tune(CURL* curl, const std::string& url) {
+    Timings timings;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, OnDiscard);
+
+    CURLcode code = curl_easy_perform(curl);
+    // CURLE_WRITE_ERROR is OnDiscard() stopping after the first byte
+    timings.ok = code == CURLE_OK || code == CURLE_WRITE_ERROR;
+    if (!timings.ok) {
+        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(code));
+    }
+
+    double dns_time = 0;
+    double connect_time = 0;
+    double tls_time = 0;
+    double ttfb = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns_time);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect_time);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls_time);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+    timings.dns_ms = dns_time * 1000;
+    timings.connect_ms = connect_time * 1000;
+    timings.tls_ms = tls_time * 1000;
+    timings.ttfb_ms = ttfb * 1000;
+    return timings;
+}
+
+static double Percentile(std::vector<double> values, double percent) {
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(percent / 100 * static_cast<double>(values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static bool RunSeries(const std::string& url, const std::string& preconnect_url, bool preconnect, int rounds) {
+    std::vector<double> dns_ms, connect_ms, tls_ms, ttfb_ms;
+
+    for (int round = 0; round < rounds; round++) {
+        CURLSH* share = CreateShare();
+        CURL* curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+
+        if (preconnect && !Preconnect(curl, preconnect_url)) {
+            fprintf(stderr, "Preconnect failed\n");
+            curl_easy_cleanup(curl);
+            curl_share_cleanup(share);
+            return false;
+        }
+
+        Timings timings = Tune(curl, url);
+        curl_easy_cleanup(curl);
+        curl_share_cleanup(share);
+        if (!timings.ok) {
+            return false;
+        }
+
+        dns_ms.push_back(timings.dns_ms);
+        connect_ms.push_back(timings.connect_ms);
+        tls_ms.push_back(timings.tls_ms);
+        ttfb_ms.push_back(timings.ttfb_ms);
+    }
+
+    // The stages are cumulative since the request started, as reported by curl
+    printf("%-11s dns %.2lf ms, connect %.2lf ms, tls %.2lf ms, ttfb p50 %.2lf ms, p95 %.2lf ms\n",
+           preconnect ? "preconnect:" : "cold:",
+           Percentile(dns_ms, 50), Percentile(connect_ms, 50), Percentile(tls_ms, 50),
+           Percentile(ttfb_ms, 50), Percentile(ttfb_ms, 95));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string url;
+    std::string preconnect_url;
+    int rounds = 20;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--preconnect-url" && has_value) {
+            preconnect_url = argv[++i];
+        } else if (arg == "--rounds" && has_value) {
+            rounds = std::max(atoi(argv[++i]), 1);
+        } else if (arg.rfind("--", 0) != 0 && url.empty()) {
+            url = arg;
+        } else {
+            url.clear();
+            break;
+        }
+    }
+
+    if (url.empty()) {
+        fprintf(stderr, "Usage: %s <url> [--preconnect-url URL] [--rounds N]\n", argv[0]);
+        return 2;
+    }
+    if (preconnect_url.empty()) {
+        preconnect_url = url;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    bool ok = RunSeries(url, preconnect_url, false, rounds) && RunSeries(url, preconnect_url, true, rounds);
+
+    curl_global_cleanup();
+    return ok ? 0 : 1;
+}
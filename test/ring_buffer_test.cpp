@@ -0,0 +1,265 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstdint>
+#include <chrono>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ring_buffer.hpp"
+#include "test_utils.hpp"
+
+static constexpr size_t kChunkSize = 188 * 64;
+static constexpr size_t kMaxChunkCount = 8;
+
+// Streams bytes through the ring, the producer alternating Write() and GetWriteRegion() and the
+// consumer alternating Read() and ReadChunkAndRetain(). Returns false on corruption.
+static bool StreamThrough(RingBuffer& buffer, size_t total_bytes, uint32_t seed) {
+    bool intact = true;
+
+    std::thread consumer([&buffer, total_bytes, seed, &intact] {
+        std::mt19937 rng(seed + 1);
+        std::vector<uint8_t> block(kChunkSize * 2);
+        uint8_t expected = 0;
+        size_t received = 0;
+        while (received < total_bytes) {
+            if (rng() % 2 == 0) {
+                size_t bytes = buffer.Read(block.data(), std::min<size_t>(1 + rng() % block.size(),
+                                                                          total_bytes - received));
+                for (size_t i = 0; i < bytes; i++) {
+                    intact = intact && block[i] == expected++;
+                }
+                received += bytes;
+            } else {
+                buffer.WaitUntilData();
+                auto [data, bytes] = buffer.ReadChunkAndRetain();
+                for (size_t i = 0; i < bytes; i++) {
+                    intact = intact && data[i] == expected++;
+                }
+                received += bytes;
+            }
+        }
+    });
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> block(kChunkSize * 2);
+    uint8_t next = 0;
+    size_t sent = 0;
+
+    while (sent < total_bytes) {
+        size_t bytes = std::min<size_t>(1 + rng() % block.size(), total_bytes - sent);
+        if (rng() % 2 == 0) {
+            for (size_t i = 0; i < bytes; i++) {
+                block[i] = next++;
+            }
+            sent += buffer.Write(block.data(), bytes);
+        } else {
+            auto [region, writable] = buffer.GetWriteRegion();
+            bytes = std::min(bytes, writable);
+            for (size_t i = 0; i < bytes; i++) {
+                region[i] = next++;
+            }
+            buffer.CommitWrite(bytes);
+            sent += bytes;
+        }
+    }
+
+    consumer.join();
+    return intact;
+}
+
+// Never drains completely, so that both cursors keep crossing the end of the storage
+static bool TestWrapAround() {
+    constexpr size_t kCapacity = 188 * 4;
+    RingBuffer buffer(188, 4, 0);
+    std::mt19937 rng(1);
+    std::vector<uint8_t> block(kCapacity);
+    uint8_t next_write = 0;
+    uint8_t next_read = 0;
+    size_t total_written = 0;
+    size_t leased = 0;
+
+    while (total_written < 1000 * kCapacity) {
+        // The lease held since the last iteration still counts against the room
+        EXPECT(buffer.ReadableBytes() + buffer.WritableBytes() + leased == kCapacity);
+        if (buffer.WritableBytes() > 0) {
+            size_t write_bytes = 1 + rng() % buffer.WritableBytes();
+            for (size_t i = 0; i < write_bytes; i++) {
+                block[i] = next_write++;
+            }
+            EXPECT(buffer.Write(block.data(), write_bytes) == write_bytes);
+            total_written += write_bytes;
+        }
+
+        if (rng() % 2 == 0) {
+            size_t read_bytes = 1 + rng() % buffer.ReadableBytes();
+            EXPECT(buffer.Read(block.data(), read_bytes) == read_bytes);
+            for (size_t i = 0; i < read_bytes; i++) {
+                EXPECT(block[i] == next_read++);
+            }
+            leased = 0;
+        } else {
+            // A lease ends at the end of the storage, the rest comes with the next one
+            auto [data, bytes] = buffer.ReadChunkAndRetain();
+            EXPECT(bytes > 0);
+            for (size_t i = 0; i < bytes; i++) {
+                EXPECT(data[i] == next_read++);
+            }
+            leased = bytes;
+        }
+    }
+    return true;
+}
+
+// A leased region is not writable until the next read releases it
+static bool TestLeaseIsReleasedByNextRead() {
+    constexpr size_t kCapacity = kChunkSize * 2;
+    RingBuffer buffer(kChunkSize, 2, 0);
+    std::vector<uint8_t> block(kCapacity, 0x47);
+    EXPECT(buffer.Write(block.data(), block.size()) == block.size());
+    EXPECT(buffer.WritableBytes() == 0);
+
+    auto [data, bytes] = buffer.ReadChunkAndRetain();
+    EXPECT(bytes == kChunkSize);
+    EXPECT(buffer.ReadableBytes() == kChunkSize);
+    EXPECT(buffer.WritableBytes() == 0);
+
+    // The next lease releases the first one
+    auto [next_data, next_bytes] = buffer.ReadChunkAndRetain();
+    EXPECT(next_data == data + kChunkSize);
+    EXPECT(next_bytes == kChunkSize);
+    EXPECT(buffer.ReadableBytes() == 0);
+    EXPECT(buffer.WritableBytes() == kChunkSize);
+
+    // Then a copying read releases the second one, even before it has data to return
+    EXPECT(buffer.Write(block.data(), 1) == 1);
+    uint8_t byte = 0;
+    EXPECT(buffer.Read(&byte, 1) == 1);
+    EXPECT(buffer.WritableBytes() == kCapacity);
+    return true;
+}
+
+// A producer parked on a full ring stays parked until the bytes drop below the new limit,
+// and never fills the ring past it afterwards
+static bool TestShrinkUnderParkedProducer() {
+    RingBuffer buffer(kChunkSize, 4, 0);
+    std::vector<uint8_t> block(kChunkSize * 4, 0x47);
+    EXPECT(buffer.Write(block.data(), block.size()) == block.size());
+
+    std::promise<size_t> written;
+    std::future<size_t> result = written.get_future();
+    std::thread producer([&buffer, &block, &written] {
+        written.set_value(buffer.Write(block.data(), kChunkSize));
+    });
+
+    // Give it time to park
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    buffer.SetCapacity(0, kChunkSize);
+    bool full = buffer.WritableBytes() == 0;
+
+    // Still three chunks above the new limit
+    std::vector<uint8_t> out(kChunkSize * 4);
+    buffer.Read(out.data(), kChunkSize);
+    bool still_parked = result.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout;
+
+    // The ring never holds more than what is left from before the shrink, or the new limit
+    bool bounded = true;
+    size_t drained = kChunkSize;
+    while (drained < kChunkSize * 5) {
+        drained += buffer.Read(out.data(), std::min(kChunkSize / 3, kChunkSize * 5 - drained));
+        size_t left = drained < kChunkSize * 4 ? kChunkSize * 4 - drained : 0;
+        bounded = bounded && buffer.ReadableBytes() <= std::max(left, kChunkSize);
+    }
+
+    bool released = result.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    if (!released) {
+        buffer.NotifyExit();
+    }
+    producer.join();
+
+    EXPECT(full);
+    EXPECT(still_parked);
+    EXPECT(released);
+    EXPECT(result.get() == kChunkSize);
+    EXPECT(bounded);
+    EXPECT(buffer.ReadableBytes() == 0);
+    return true;
+}
+
+// WaitUntilEmpty() returns once the consumer has leased the last bytes, without another read
+static bool TestWaitUntilEmpty() {
+    RingBuffer buffer(kChunkSize, 4, 0);
+    std::vector<uint8_t> block(kChunkSize, 0x47);
+    EXPECT(buffer.Write(block.data(), block.size()) == block.size());
+
+    std::future<void> emptied = std::async(std::launch::async, [&buffer] {
+        buffer.WaitUntilEmpty();
+    });
+    bool waited = emptied.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout;
+
+    // One lease takes it all, no earlier lease is released on the way
+    buffer.ReadChunkAndRetain();
+    bool returned = emptied.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    if (!returned) {
+        buffer.NotifyExit();
+    }
+    emptied.wait();
+
+    EXPECT(waited);
+    EXPECT(returned);
+    return true;
+}
+
+// After Purge(), nothing before the next sync byte may come out, even when the garbage
+// runs up to the end of the storage and the packet sits past the wrap
+static bool TestPurgeResyncsAcrossWrap() {
+    for (int lease = 0; lease < 2; lease++) {
+        RingBuffer buffer(188, 4, 0);
+        std::vector<uint8_t> block(700, 0x11);
+        EXPECT(buffer.Write(block.data(), block.size()) == block.size());
+        EXPECT(buffer.Read(block.data(), block.size()) == block.size());
+        EXPECT(buffer.Purge() == 0);
+
+        // 52 bytes of garbage up to the end of the storage, 10 more after the wrap, then a packet
+        std::vector<uint8_t> data(62 + 188, 0x11);
+        data[62] = 0x47;
+        EXPECT(buffer.Write(data.data(), data.size()) == data.size());
+
+        uint8_t first = 0;
+        if (lease) {
+            auto [chunk, bytes] = buffer.ReadChunkAndRetain();
+            EXPECT(bytes == 188);
+            first = chunk[0];
+        } else {
+            EXPECT(buffer.Read(block.data(), 188) == 188);
+            first = block[0];
+        }
+        EXPECT(first == 0x47);
+        EXPECT(buffer.GetStats().purged_bytes == 62);
+    }
+    return true;
+}
+
+static bool TestStreamThrough() {
+    RingBuffer buffer(kChunkSize, kMaxChunkCount, 0);
+    EXPECT(StreamThrough(buffer, 64 * 1024 * 1024, 2));
+
+    // Again with a soft limit below the storage, not a multiple of the chunk size
+    RingBuffer limited(kChunkSize, kMaxChunkCount, 0);
+    limited.SetCapacity(0, kChunkSize * 3 + 100);
+    EXPECT(StreamThrough(limited, 16 * 1024 * 1024, 3));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int failures = 0;
+    RUN_TEST(TestWrapAround, failures);
+    RUN_TEST(TestLeaseIsReleasedByNextRead, failures);
+    RUN_TEST(TestShrinkUnderParkedProducer, failures);
+    RUN_TEST(TestWaitUntilEmpty, failures);
+    RUN_TEST(TestPurgeResyncsAcrossWrap, failures);
+    RUN_TEST(TestStreamThrough, failures);
+    return failures == 0 ? 0 : 1;
+}
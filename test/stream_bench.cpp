@@ -0,0 +1,407 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+// CPU per MB of the live stream receive paths, against any HTTP server serving a large file or a stream:
+//
+//   BonDriver_EPGStation_stream_bench <url> [--mode cpr|zerocopy|native] [--buffer blocking|ring] [--rounds N] [--seconds N]
+//                                     [--receive-buffer-kb N] [--curl-buffer-kb N] [--tcp-nodelay 0|1]
+//
+// cpr:      curl -> std::string -> std::function -> StreamBuffer::Write(), as cpr's WriteCallback does
+// zerocopy: curl -> StreamBuffer::Write() straight from CURLOPT_WRITEFUNCTION (zeroCopyReceive: true)
+// native:   NativeHttpClient recv() straight into the ring, or into a bounce buffer and
+//           StreamBuffer::Write() with the blocking buffer (nativeHttp: true, plain http only)
+//
+// A consumer thread drains the buffer like a host calling GetTsStream(). Process CPU time covers both.
+// Each round runs to the end of the response, or for --seconds on a live stream.
+// The socket options match the socket: section of the config (receiveBufferKB, curlBufferKB, tcpNoDelay).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <Windows.h>
+#else
+    #include <sys/resource.h>
+    #include <sys/socket.h>
+#endif
+#include <curl/curl.h>
+#include "blocking_buffer.hpp"
+#include "native_http_client.hpp"
+#include "ring_buffer.hpp"
+
+static constexpr size_t kChunkSize = 188 * 1024;
+static constexpr size_t kMaxChunkCount = 32;
+// Same as StreamLoader::kNativeReceiveBufferSize
+static constexpr size_t kNativeReceiveBufferSize = 256 * 1024;
+
+enum class ReceiveMode {
+    kCprString,
+    kZeroCopy,
+    kNative
+};
+
+struct BenchOptions {
+    std::string url;
+    ReceiveMode mode = ReceiveMode::kZeroCopy;
+    StreamBufferType buffer_type = kStreamBufferTypeBlocking;
+    int rounds = 3;
+    // 0 to run until the response ends
+    int seconds = 0;
+    // SO_RCVBUF and CURLOPT_BUFFERSIZE, 0 for the defaults
+    int receive_buffer_bytes = 0;
+    long curl_buffer_bytes = 0;
+    std::optional<bool> tcp_no_delay;
+};
+
+struct BenchResult {
+    bool ok = false;
+    uint64_t bytes = 0;
+    uint64_t callbacks = 0;
+    double seconds = 0;
+    double cpu_seconds = 0;
+};
+
+static double GetProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+
+    auto to_seconds = [](const FILETIME& ft) {
+        uint64_t ticks = (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+        return ticks / 10000000.0;
+    };
+
+    return to_seconds(kernel_time) + to_seconds(user_time);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    auto to_seconds = [](const timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1000000.0;
+    };
+
+    return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+#endif
+}
+
+class Receiver {
+public:
+    Receiver(StreamBuffer& buffer, ReceiveMode mode, int seconds) : buffer_(buffer), mode_(mode) {
+        on_write_ = std::bind(&Receiver::OnStringData, this, std::placeholders::_1);
+        if (seconds > 0) {
+            deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        }
+    }
+
+    static size_t OnCurlWrite(char* ptr, size_t size, size_t nmemb, void* userdata) {
+        auto* self = static_cast<Receiver*>(userdata);
+        size_t bytes = size * nmemb;
+        self->callbacks_++;
+
+        if (self->deadline_.has_value() && std::chrono::steady_clock::now() >= self->deadline_.value()) {
+            // Aborts the transfer with CURLE_WRITE_ERROR
+            self->timed_out_ = true;
+            return 0;
+        }
+
+        if (self->mode_ == ReceiveMode::kCprString) {
+            return self->on_write_(std::string(ptr, bytes)) ? bytes : 0;
+        }
+
+        self->buffer_.Write(reinterpret_cast<const uint8_t*>(ptr), bytes);
+        return bytes;
+    }
+
+    uint64_t Callbacks() const {
+        return callbacks_;
+    }
+
+    bool TimedOut() const {
+        return timed_out_;
+    }
+private:
+    bool OnStringData(std::string data) {
+        buffer_.Write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        return true;
+    }
+private:
+    StreamBuffer& buffer_;
+    ReceiveMode mode_;
+    std::function<bool(std::string)> on_write_;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    bool timed_out_ = false;
+    uint64_t callbacks_ = 0;
+};
+
+// The receive side of StreamLoader::OpenNative()
+class NativeReceiver : public NativeHttpClient::Sink {
+public:
+    NativeReceiver(StreamBuffer& buffer, int receive_buffer_bytes, int seconds)
+        : buffer_(buffer), receive_buffer_bytes_(receive_buffer_bytes), bounce_buffer_(kNativeReceiveBufferSize) {
+        if (seconds > 0) {
+            deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        }
+    }
+
+    void OnNativeSocketOpened(SOCKET sock) override {
+        if (receive_buffer_bytes_ > 0) {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF,
+                       reinterpret_cast<const char*>(&receive_buffer_bytes_), sizeof(receive_buffer_bytes_));
+        }
+    }
+
+    bool OnNativeResponse(int status_code, const NativeHttpClient::Timings& /*timings*/) override {
+        if (status_code != 200) {
+            fprintf(stderr, "Unexpected status code: %d\n", status_code);
+            return false;
+        }
+        return true;
+    }
+
+    std::pair<uint8_t*, size_t> GetNativeReceiveRegion() override {
+        if (deadline_.has_value() && std::chrono::steady_clock::now() >= deadline_.value()) {
+            // An empty region cancels the transfer
+            timed_out_ = true;
+            return {nullptr, 0};
+        }
+
+        std::pair<uint8_t*, size_t> region = buffer_.GetWriteRegion();
+        if (region.second > 0) {
+            return region;
+        }
+        return {bounce_buffer_.data(), bounce_buffer_.size()};
+    }
+
+    bool OnNativeData(uint8_t* data, size_t bytes) override {
+        callbacks_++;
+        if (data == bounce_buffer_.data()) {
+            buffer_.Write(data, bytes);
+        } else {
+            buffer_.CommitWrite(bytes);
+        }
+        return true;
+    }
+
+    uint64_t Callbacks() const {
+        return callbacks_;
+    }
+
+    bool TimedOut() const {
+        return timed_out_;
+    }
+private:
+    StreamBuffer& buffer_;
+    int receive_buffer_bytes_;
+    std::vector<uint8_t> bounce_buffer_;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    bool timed_out_ = false;
+    uint64_t callbacks_ = 0;
+};
+
+// No prebuffering, WaitUntilData() returns as soon as anything is readable
+static int OnSocketOption(void* clientp, curl_socket_t curlfd, curlsocktype purpose) {
+    auto* options = static_cast<const BenchOptions*>(clientp);
+    if (purpose != CURLSOCKTYPE_IPCXN || options->receive_buffer_bytes <= 0) {
+        return CURL_SOCKOPT_OK;
+    }
+
+    // Before connecting, so that the window scale can follow
+    int receive_buffer_bytes = options->receive_buffer_bytes;
+    setsockopt(curlfd, SOL_SOCKET, SO_RCVBUF,
+               reinterpret_cast<const char*>(&receive_buffer_bytes), sizeof(receive_buffer_bytes));
+    return CURL_SOCKOPT_OK;
+}
+
+static std::unique_ptr<StreamBuffer> CreateBuffer(StreamBufferType buffer_type) {
+    if (buffer_type == kStreamBufferTypeRing) {
+        return std::make_unique<RingBuffer>(kChunkSize, kMaxChunkCount, 0);
+    }
+    // Counted in chunks, a partially filled one is enough
+    return std::make_unique<BlockingBuffer>(kChunkSize, kMaxChunkCount, 1);
+}
+
+// Like a host calling GetTsStream(), returns the bytes drained once the buffer has been told to exit
+static std::thread StartConsumer(StreamBuffer& buffer, std::atomic<uint64_t>& consumed) {
+    return std::thread([&buffer, &consumed] {
+        while (true) {
+            buffer.WaitUntilData();
+            size_t bytes = buffer.ReadChunkAndRetain().second;
+            if (bytes == 0 && buffer.IsExit()) {
+                break;
+            }
+            consumed += bytes;
+        }
+    });
+}
+
+static BenchResult RunNativeRound(const BenchOptions& options) {
+    BenchResult result;
+    std::unique_ptr<StreamBuffer> buffer = CreateBuffer(options.buffer_type);
+    std::atomic<uint64_t> consumed = 0;
+    std::thread consumer = StartConsumer(*buffer, consumed);
+
+    NativeReceiver receiver(*buffer, options.receive_buffer_bytes, options.seconds);
+    NativeHttpClient client;
+
+    double cpu_begin = GetProcessCpuSeconds();
+    auto time_begin = std::chrono::steady_clock::now();
+
+    NativeHttpClient::Result code = client.Get(options.url, {}, receiver);
+    buffer->WaitUntilEmpty();
+    buffer->NotifyExit();
+    consumer.join();
+
+    result.cpu_seconds = GetProcessCpuSeconds() - cpu_begin;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_begin).count();
+    result.ok = code == NativeHttpClient::Result::kCompleted || receiver.TimedOut();
+    result.bytes = consumed;
+    result.callbacks = receiver.Callbacks();
+
+    if (!result.ok) {
+        fprintf(stderr, "NativeHttpClient::Get() failed\n");
+    }
+    return result;
+}
+
+static BenchResult RunRound(const BenchOptions& options) {
+    if (options.mode == ReceiveMode::kNative) {
+        return RunNativeRound(options);
+    }
+
+    BenchResult result;
+    std::unique_ptr<StreamBuffer> buffer = CreateBuffer(options.buffer_type);
+    std::atomic<uint64_t> consumed = 0;
+    std::thread consumer = StartConsumer(*buffer, consumed);
+
+    Receiver receiver(*buffer, options.mode, options.seconds);
+    CURL* curl = curl_easy_init();
+    curl_easy_setopt(curl, CURLOPT_URL, options.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Receiver::OnCurlWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &receiver);
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, OnSocketOption);
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, &options);
+    if (options.curl_buffer_bytes > 0) {
+        curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, options.curl_buffer_bytes);
+    }
+    if (options.tcp_no_delay.has_value()) {
+        curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, options.tcp_no_delay.value() ? 1L : 0L);
+    }
+
+    double cpu_begin = GetProcessCpuSeconds();
+    auto time_begin = std::chrono::steady_clock::now();
+
+    CURLcode code = curl_easy_perform(curl);
+    buffer->WaitUntilEmpty();
+    buffer->NotifyExit();
+    consumer.join();
+
+    result.cpu_seconds = GetProcessCpuSeconds() - cpu_begin;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_begin).count();
+    result.ok = code == CURLE_OK || receiver.TimedOut();
+    result.bytes = consumed;
+    result.callbacks = receiver.Callbacks();
+
+    if (!result.ok) {
+        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(code));
+    }
+
+    curl_easy_cleanup(curl);
+    return result;
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--mode" && has_value) {
+            std::string mode = argv[++i];
+            if (mode == "cpr") {
+                options.mode = ReceiveMode::kCprString;
+            } else if (mode == "zerocopy") {
+                options.mode = ReceiveMode::kZeroCopy;
+            } else if (mode == "native") {
+                options.mode = ReceiveMode::kNative;
+            } else {
+                return false;
+            }
+        } else if (arg == "--buffer" && has_value) {
+            std::string buffer = argv[++i];
+            options.buffer_type = buffer == "ring" ? kStreamBufferTypeRing : kStreamBufferTypeBlocking;
+        } else if (arg == "--rounds" && has_value) {
+            options.rounds = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--seconds" && has_value) {
+            options.seconds = std::max(atoi(argv[++i]), 0);
+        } else if (arg == "--receive-buffer-kb" && has_value) {
+            options.receive_buffer_bytes = std::clamp(atoi(argv[++i]), 0, 1024 * 1024) * 1024;
+        } else if (arg == "--curl-buffer-kb" && has_value) {
+            options.curl_buffer_bytes = std::clamp(atoi(argv[++i]), 0, 10 * 1024) * 1024L;
+        } else if (arg == "--tcp-nodelay" && has_value) {
+            options.tcp_no_delay = atoi(argv[++i]) != 0;
+        } else if (arg.rfind("--", 0) != 0 && options.url.empty()) {
+            options.url = arg;
+        } else {
+            return false;
+        }
+    }
+
+    if (options.url.empty()) {
+        return false;
+    }
+    if (options.mode == ReceiveMode::kNative && !NativeHttpClient::CanHandle(options.url, std::nullopt)) {
+        fprintf(stderr, "The native HTTP client only handles plain http urls\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s <url> [--mode cpr|zerocopy|native] [--buffer blocking|ring] [--rounds N] [--seconds N]\n"
+                        "       [--receive-buffer-kb N] [--curl-buffer-kb N] [--tcp-nodelay 0|1]\n",
+                argv[0]);
+        return 2;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    double best_ms_per_mb = 0;
+
+    for (int round = 0; round < options.rounds; round++) {
+        BenchResult result = RunRound(options);
+        if (!result.ok || result.bytes == 0) {
+            curl_global_cleanup();
+            return 1;
+        }
+
+        double megabytes = result.bytes / 1048576.0;
+        double ms_per_mb = result.cpu_seconds * 1000 / megabytes;
+        best_ms_per_mb = round == 0 ? ms_per_mb : std::min(best_ms_per_mb, ms_per_mb);
+
+        printf("round %d: %.1lf MB in %.2lf s, cpu %.3lf ms/MB, %llu callbacks (%.0lf/s, avg %.1lf KiB)\n",
+               round + 1, megabytes, result.seconds, ms_per_mb,
+               static_cast<unsigned long long>(result.callbacks), result.callbacks / result.seconds,
+               result.bytes / 1024.0 / static_cast<double>(result.callbacks));
+    }
+
+    printf("best: %.3lf ms/MB\n", best_ms_per_mb);
+
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,30 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#ifndef BONDRIVER_EPGSTATION_TEST_UTILS_HPP
+#define BONDRIVER_EPGSTATION_TEST_UTILS_HPP
+
+#include <cstdio>
+
+// Fails the enclosing test function, which returns bool
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: EXPECT(%s) failed\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (0)
+
+// Runs a bool test function and counts it in failures
+#define RUN_TEST(test, failures) \
+    do { \
+        bool passed = (test)(); \
+        printf("%s: %s\n", passed ? "PASS" : "FAIL", #test); \
+        if (!passed) { \
+            (failures)++; \
+        } \
+    } while (0)
+
+
+#endif // BONDRIVER_EPGSTATION_TEST_UTILS_HPP
@@ -0,0 +1,189 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstdint>
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+#include "ring_buffer.hpp"
+#include "ts_packet_aligner.hpp"
+#include "ts_utils.hpp"
+#include "test_utils.hpp"
+
+using TsUtils::kPacketSize;
+using TsUtils::kSyncByte;
+
+using Bytes = std::vector<uint8_t>;
+
+// Packets whose payload tells them apart and never contains a sync byte
+static Bytes MakePackets(size_t count, size_t first_index, bool transport_error = false) {
+    Bytes packets(count * kPacketSize);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* packet = packets.data() + i * kPacketSize;
+        std::fill(packet, packet + kPacketSize, static_cast<uint8_t>(0x10 + (first_index + i) % 0x30));
+        packet[0] = kSyncByte;
+        packet[1] = transport_error ? TsUtils::kTransportErrorIndicator : 0;
+    }
+    return packets;
+}
+
+static Bytes Garbage(size_t bytes) {
+    return Bytes(bytes, 0x11);
+}
+
+static Bytes Concat(std::initializer_list<Bytes> parts) {
+    Bytes result;
+    for (const Bytes& part : parts) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
+
+// Everything the aligner has written so far
+static Bytes Drain(RingBuffer& buffer) {
+    Bytes result;
+    while (buffer.ReadableBytes() > 0) {
+        size_t pos = result.size();
+        result.resize(pos + buffer.ReadableBytes());
+        result.resize(pos + buffer.Read(result.data() + pos, result.size() - pos));
+    }
+    return result;
+}
+
+static size_t Push(TsPacketAligner& aligner, const Bytes& data, RingBuffer& buffer) {
+    return aligner.Push(data.data(), data.size(), buffer);
+}
+
+// A packet cut anywhere between two blocks comes out whole, and nothing counts as dropped
+static bool TestPacketSplitAcrossPushes() {
+    Bytes stream = MakePackets(4, 0);
+
+    for (size_t split = 0; split <= stream.size(); split++) {
+        RingBuffer buffer(kPacketSize * 8, 4, 0);
+        TsPacketAligner aligner;
+        size_t written = aligner.Push(stream.data(), split, buffer);
+        written += aligner.Push(stream.data() + split, stream.size() - split, buffer);
+
+        EXPECT(written == stream.size());
+        EXPECT(Drain(buffer) == stream);
+        EXPECT(aligner.ResyncCount() == 0);
+        EXPECT(aligner.DroppedBytes() == 0);
+    }
+
+    // One byte per block, the carried packet completes on a block boundary every time
+    RingBuffer buffer(kPacketSize * 8, 4, 0);
+    TsPacketAligner aligner;
+    for (uint8_t byte : stream) {
+        aligner.Push(&byte, 1, buffer);
+    }
+    EXPECT(Drain(buffer) == stream);
+    EXPECT(aligner.DroppedBytes() == 0);
+    return true;
+}
+
+// A sync byte near the end of a block starts a carried packet, which is dropped once the
+// next block shows that no sync byte follows it
+static bool TestFalseSyncAtBlockTail() {
+    RingBuffer buffer(kPacketSize * 8, 4, 0);
+    TsPacketAligner aligner;
+
+    Bytes head = MakePackets(2, 0);
+    Bytes false_packet = Garbage(kPacketSize);
+    false_packet[0] = kSyncByte;
+    Bytes tail = MakePackets(3, 2);
+
+    EXPECT(Push(aligner, Concat({head, Bytes(false_packet.begin(), false_packet.begin() + 50)}), buffer) == head.size());
+    EXPECT(Push(aligner, Concat({Bytes(false_packet.begin() + 50, false_packet.end()), Garbage(20), tail}), buffer) ==
+           tail.size());
+
+    EXPECT(Drain(buffer) == Concat({head, tail}));
+    EXPECT(aligner.ResyncCount() == 1);
+    EXPECT(aligner.DroppedBytes() == kPacketSize + 20);
+    return true;
+}
+
+// Garbage between runs of packets is skipped, and each loss of sync is counted once
+static bool TestGarbageBetweenRuns() {
+    RingBuffer buffer(kPacketSize * 8, 4, 0);
+    TsPacketAligner aligner;
+
+    // Garbage before the first packet is dropped, but it is not a resync. A run found after
+    // garbage must be long enough for the sync lookahead, unless it ends the block.
+    Bytes first = MakePackets(TsUtils::kSyncLookahead + 1, 0);
+    Bytes second = MakePackets(TsUtils::kSyncLookahead + 1, 3);
+    Bytes third = MakePackets(1, 6);
+    Bytes stream = Concat({Garbage(7), first, Garbage(100), second, Garbage(kPacketSize + 1), third});
+
+    EXPECT(Push(aligner, stream, buffer) == first.size() + second.size() + third.size());
+    EXPECT(Drain(buffer) == Concat({first, second, third}));
+    EXPECT(aligner.ResyncCount() == 2);
+    EXPECT(aligner.DroppedBytes() == 7 + 100 + kPacketSize + 1);
+
+    // Garbage spread over several blocks is still one resync
+    Bytes fourth = MakePackets(2, 7);
+    Push(aligner, Garbage(30), buffer);
+    Push(aligner, Garbage(30), buffer);
+    Push(aligner, fourth, buffer);
+    EXPECT(Drain(buffer) == fourth);
+    EXPECT(aligner.ResyncCount() == 3);
+    EXPECT(aligner.DroppedBytes() == 7 + 100 + kPacketSize + 1 + 60);
+    return true;
+}
+
+// Reset() drops the carried partial packet, and what comes next before a sync byte is not a resync
+static bool TestReset() {
+    RingBuffer buffer(kPacketSize * 8, 4, 0);
+    TsPacketAligner aligner;
+
+    Bytes old_stream = MakePackets(2, 0);
+    EXPECT(aligner.Push(old_stream.data(), kPacketSize + 100, buffer) == kPacketSize);
+    aligner.Reset();
+    EXPECT(aligner.DroppedBytes() == 100);
+
+    // The rest of the old packet arrives first, as if from a stream being torn down
+    Bytes new_stream = MakePackets(3, 10);
+    Bytes rest(old_stream.begin() + kPacketSize + 100, old_stream.end());
+    EXPECT(Push(aligner, Concat({rest, new_stream}), buffer) == new_stream.size());
+
+    EXPECT(Drain(buffer) == Concat({Bytes(old_stream.begin(), old_stream.begin() + kPacketSize), new_stream}));
+    EXPECT(aligner.ResyncCount() == 0);
+    EXPECT(aligner.DroppedBytes() == kPacketSize);
+    return true;
+}
+
+// Packets with transport_error_indicator set pass through and are counted, carried ones included
+static bool TestTransportErrors() {
+    RingBuffer buffer(kPacketSize * 8, 4, 0);
+    TsPacketAligner aligner;
+
+    Bytes stream = Concat({MakePackets(2, 0), MakePackets(3, 2, true), MakePackets(1, 5)});
+    // Cut inside the fourth packet, which is carried over
+    size_t split = kPacketSize * 3 + 60;
+    aligner.Push(stream.data(), split, buffer);
+    EXPECT(aligner.TransportErrorCount() == 1);
+    aligner.Push(stream.data() + split, stream.size() - split, buffer);
+
+    EXPECT(Drain(buffer) == stream);
+    EXPECT(aligner.TransportErrorCount() == 3);
+
+    // A dropped false sync doesn't count, whatever its second byte
+    Bytes false_packet = Garbage(kPacketSize);
+    false_packet[0] = kSyncByte;
+    false_packet[1] = TsUtils::kTransportErrorIndicator;
+    Push(aligner, Bytes(false_packet.begin(), false_packet.begin() + 10), buffer);
+    Push(aligner, Concat({Bytes(false_packet.begin() + 10, false_packet.end()), Garbage(5), MakePackets(1, 6)}), buffer);
+    EXPECT(Drain(buffer) == MakePackets(1, 6));
+    EXPECT(aligner.TransportErrorCount() == 3);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int failures = 0;
+    RUN_TEST(TestPacketSplitAcrossPushes, failures);
+    RUN_TEST(TestFalseSyncAtBlockTail, failures);
+    RUN_TEST(TestGarbageBetweenRuns, failures);
+    RUN_TEST(TestReset, failures);
+    RUN_TEST(TestTransportErrors, failures);
+    return failures == 0 ? 0 : 1;
+}
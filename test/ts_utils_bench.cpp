@@ -0,0 +1,90 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+// Throughput of the TS scanners, no server needed:
+//
+//   BonDriver_EPGStation_ts_utils_bench [--mb N] [--rounds N]
+//
+// FindSyncOffset() is timed on random bytes with the only packet train at the very end,
+// the worst case of a resync. ScanPacketRun() is timed on a clean stream.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "ts_utils.hpp"
+
+using TsUtils::kPacketSize;
+using TsUtils::kSyncByte;
+
+template <typename Function>
+static double MeasureGBps(size_t bytes, int rounds, Function&& function) {
+    double best_seconds = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        auto begin = std::chrono::steady_clock::now();
+        function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        best_seconds = round == 0 ? seconds : std::min(best_seconds, seconds);
+    }
+
+    return bytes / best_seconds / 1e9;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = 64;
+    int rounds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--mb" && has_value) {
+            megabytes = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--rounds" && has_value) {
+            rounds = std::max(atoi(argv[++i]), 1);
+        } else {
+            fprintf(stderr, "Usage: %s [--mb N] [--rounds N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    size_t size = megabytes * 1024 * 1024;
+    std::vector<uint8_t> data(size);
+    std::mt19937 rng(1);
+    for (uint8_t& byte : data) {
+        // No sync byte at all, so that no position can match early
+        byte = static_cast<uint8_t>(rng() % 255);
+        byte += byte >= kSyncByte;
+    }
+    for (size_t pos = size - kPacketSize * 4; pos < size; pos += kPacketSize) {
+        data[pos] = kSyncByte;
+    }
+
+    printf("FindSyncOffset(), %zu MB, best of %d (in use: %s)\n", megabytes, rounds, TsUtils::SyncScannerName());
+
+    for (const TsUtils::SyncScanner& scanner : TsUtils::AvailableSyncScanners()) {
+        size_t offset = 0;
+        double gbps = MeasureGBps(size, rounds, [&] {
+            offset = scanner.find_sync_offset(data.data(), size);
+        });
+        printf("  %-8s %6.2lf GB/s (offset %zu)\n", scanner.name, gbps, offset);
+    }
+
+    for (size_t pos = 0; pos + kPacketSize <= size; pos += kPacketSize) {
+        data[pos] = kSyncByte;
+    }
+
+    size_t run = 0;
+    uint64_t transport_errors = 0;
+    double gbps = MeasureGBps(size, rounds, [&] {
+        run = TsUtils::ScanPacketRun(data.data(), size, transport_errors);
+    });
+    printf("ScanPacketRun()\n  %-8s %6.2lf GB/s (run %zu)\n", "strided", gbps, run);
+    return 0;
+}
@@ -0,0 +1,149 @@
+//
+// @author magicxqq <xqq@xqq.im>
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+#include "ts_utils.hpp"
+#include "test_utils.hpp"
+
+using TsUtils::kPacketSize;
+using TsUtils::kSyncByte;
+
+// Reference for ScanPacketRun(), one packet at a time
+static size_t ScanPacketRunNaive(const uint8_t* data, size_t size, uint64_t& transport_errors) {
+    size_t pos = 0;
+    while (pos + kPacketSize <= size && data[pos] == kSyncByte) {
+        if (data[pos + 1] & TsUtils::kTransportErrorIndicator) {
+            transport_errors++;
+        }
+        pos += kPacketSize;
+    }
+    return pos;
+}
+
+// Every scanner must agree with the scalar reference on data at every alignment
+static bool CheckScanners(const uint8_t* data, size_t size) {
+    static const std::vector<TsUtils::SyncScanner> scanners = TsUtils::AvailableSyncScanners();
+    size_t expected = scanners[0].find_sync_offset(data, size);
+
+    for (const TsUtils::SyncScanner& scanner : scanners) {
+        size_t offset = scanner.find_sync_offset(data, size);
+        if (offset != expected) {
+            printf("%s: %zu, scalar: %zu, size: %zu\n", scanner.name, offset, expected, size);
+            return false;
+        }
+    }
+
+    size_t offset = TsUtils::FindSyncOffset(data, size);
+    if (offset != expected) {
+        printf("FindSyncOffset(): %zu, scalar: %zu, size: %zu\n", offset, expected, size);
+        return false;
+    }
+    return true;
+}
+
+static bool TestScalarReference() {
+    std::vector<uint8_t> data(kPacketSize * 4, 0);
+    EXPECT(TsUtils::FindSyncOffset(data.data(), data.size()) == data.size());
+
+    // Lookahead packets past the end don't count against a position
+    data[kPacketSize * 3 + 10] = kSyncByte;
+    EXPECT(TsUtils::FindSyncOffset(data.data(), data.size()) == kPacketSize * 3 + 10);
+
+    // A lone sync byte with a mismatching lookahead inside the buffer is skipped
+    data[5] = kSyncByte;
+    data[5 + kPacketSize * 2] = kSyncByte;
+    EXPECT(TsUtils::FindSyncOffset(data.data(), data.size()) == kPacketSize * 3 + 10);
+    data[5 + kPacketSize] = kSyncByte;
+    EXPECT(TsUtils::FindSyncOffset(data.data(), data.size()) == 5);
+    return true;
+}
+
+// Random bytes with varying sync byte density, some with a planted packet train
+static bool TestRandomInputs() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> storage(4096 + 64);
+
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        size_t size = rng() % 4096;
+        // Misaligned on purpose
+        uint8_t* data = storage.data() + rng() % 32;
+        uint32_t density = 2 + rng() % 8;
+
+        for (size_t i = 0; i < size; i++) {
+            data[i] = rng() % density == 0 ? kSyncByte : static_cast<uint8_t>(rng());
+        }
+        if (size > 0 && rng() % 2 == 0) {
+            for (size_t pos = rng() % size; pos < size; pos += kPacketSize) {
+                data[pos] = kSyncByte;
+            }
+        }
+
+        EXPECT(CheckScanners(data, size));
+    }
+    return true;
+}
+
+// Every length around the vector widths and the lookahead span, with the answer near the end.
+// The allocation ends right at the data, so that an address sanitizer build catches over-reads.
+static bool TestTailLengths() {
+    for (size_t misalignment = 0; misalignment < 32; misalignment++) {
+        for (size_t size = 0; size <= kPacketSize * 4; size++) {
+            std::unique_ptr<uint8_t[]> storage(new uint8_t[misalignment + size]);
+            uint8_t* data = storage.get() + misalignment;
+
+            for (size_t sync_pos = size >= 40 ? size - 40 : 0; sync_pos <= size; sync_pos++) {
+                std::fill(data, data + size, 0);
+                for (size_t pos = sync_pos; pos < size; pos += kPacketSize) {
+                    data[pos] = kSyncByte;
+                }
+                EXPECT(CheckScanners(data, size));
+            }
+        }
+    }
+    return true;
+}
+
+static bool TestScanPacketRun() {
+    std::mt19937 rng(2);
+    std::vector<uint8_t> data(kPacketSize * 64);
+
+    for (int iteration = 0; iteration < 10000; iteration++) {
+        for (uint8_t& byte : data) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        // A run of packets, broken somewhere, then a partial packet
+        size_t packets = rng() % 64;
+        for (size_t i = 0; i < packets; i++) {
+            data[i * kPacketSize] = kSyncByte;
+        }
+        size_t size = packets * kPacketSize + rng() % kPacketSize;
+        size = std::min(size, data.size());
+
+        uint64_t errors = 0;
+        uint64_t expected_errors = 0;
+        EXPECT(TsUtils::ScanPacketRun(data.data(), size, errors) ==
+               ScanPacketRunNaive(data.data(), size, expected_errors));
+        EXPECT(errors == expected_errors);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int failures = 0;
+
+    for (const TsUtils::SyncScanner& scanner : TsUtils::AvailableSyncScanners()) {
+        printf("Checking scanner: %s\n", scanner.name);
+    }
+
+    RUN_TEST(TestScalarReference, failures);
+    RUN_TEST(TestRandomInputs, failures);
+    RUN_TEST(TestTailLengths, failures);
+    RUN_TEST(TestScanPacketRun, failures);
+    return failures == 0 ? 0 : 1;
+}